@@ -0,0 +1,224 @@
+#pragma once
+
+// Debug counter of global operator new calls, attributed to the innermost AllocScope label.
+//
+// With BH_TRACK_ALLOCATIONS defined this header replaces the global new/delete, so it must be
+// included from exactly one translation unit. Without it the API compiles to nothing.
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <utility>
+
+struct AllocTracker
+{
+    struct Offender
+    {
+        std::atomic<const char*> label = nullptr;
+        std::atomic<uint64_t> count = 0;
+    };
+
+    static constexpr const char* UNTAGGED = "untagged";
+
+    // Fixed table so that recording never allocates; labels are compared by address
+    std::array<Offender, 32> offenders;
+    std::atomic<uint64_t> count = 0;
+    std::atomic<uint64_t> bytes = 0;
+    std::atomic<uint64_t> exempt = 0; // made inside exempt scopes (driver, windowing), not in `count`
+
+    static AllocTracker& instance()
+    {
+        static AllocTracker tracker;
+        return tracker;
+    }
+
+    struct Scope
+    {
+        const char* label = nullptr;
+        bool exempt = false;
+    };
+
+    static Scope& scope()
+    {
+        thread_local Scope current;
+        return current;
+    }
+
+    // Counted allocations made by the calling thread, for checks that must not be charged with
+    // the sim thread's or the workers'
+    static uint64_t& threadCount()
+    {
+        thread_local uint64_t current = 0;
+        return current;
+    }
+
+    void record(size_t size)
+    {
+        if (scope().exempt)
+        {
+            exempt.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        ++threadCount();
+        count.fetch_add(1, std::memory_order_relaxed);
+        bytes.fetch_add(size, std::memory_order_relaxed);
+        const char* label = scope().label ? scope().label : UNTAGGED;
+        for (auto& o : offenders)
+        {
+            const char* expected = nullptr;
+            if (o.label.load(std::memory_order_relaxed) == label ||
+                o.label.compare_exchange_strong(expected, label) || expected == label)
+            {
+                o.count.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+    }
+
+    // Zero the per-label counts, returning the total since the last call
+    uint64_t takeCount()
+    {
+        for (auto& o : offenders)
+            o.count.store(0, std::memory_order_relaxed);
+        return count.exchange(0, std::memory_order_relaxed);
+    }
+
+    template <typename Fn>
+    void forEachOffender(Fn&& fn) const
+    {
+        for (const auto& o : offenders)
+            if (const char* label = o.label.load(std::memory_order_relaxed); label && o.count.load(std::memory_order_relaxed))
+                fn(label, o.count.load(std::memory_order_relaxed));
+    }
+};
+
+// Labels allocations made on this thread until the end of the scope. Exempt scopes cover code we
+// don't own, such as GL drivers and GLFW, whose allocations are counted apart.
+struct AllocScope
+{
+#ifdef BH_TRACK_ALLOCATIONS
+    AllocTracker::Scope previous;
+
+    explicit AllocScope(const char* label, bool exempt = false)
+        : previous(AllocTracker::scope())
+    {
+        AllocTracker::scope() = {label, exempt || previous.exempt};
+    }
+
+    ~AllocScope()
+    {
+        AllocTracker::scope() = previous;
+    }
+#else
+    explicit AllocScope(const char*, bool = false)
+    {
+    }
+#endif
+};
+
+// Called on the render thread at the end of each frame: once warm-up is over, any counted
+// allocation that frame made on this thread is reported with the scopes behind it and asserts.
+// Other threads' allocations are not charged to the frame; the scopes listed are all threads'.
+struct FrameAllocCheck
+{
+    int warmupFrames = 120;
+    int frame = 0;
+
+    void endFrame()
+    {
+#ifdef BH_TRACK_ALLOCATIONS
+        AllocTracker& tracker = AllocTracker::instance();
+        const uint64_t allocations = std::exchange(AllocTracker::threadCount(), 0);
+        if (++frame > warmupFrames && allocations > 0)
+        {
+            std::cerr << "\n[ALLOC] frame " << frame << ": " << allocations << " heap allocations on the render thread; scopes:";
+            tracker.forEachOffender([](const char* label, uint64_t n) { std::cerr << ' ' << label << " x" << n; });
+            std::cerr << '\n';
+            assert(allocations == 0 && "heap allocations on the render thread in steady state");
+        }
+        tracker.takeCount();
+#endif
+    }
+};
+
+#ifdef BH_TRACK_ALLOCATIONS
+void* operator new(size_t size)
+{
+    AllocTracker::instance().record(size);
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, std::align_val_t align)
+{
+    AllocTracker::instance().record(size);
+    const size_t a = static_cast<size_t>(align);
+#ifdef _WIN32
+    if (void* p = _aligned_malloc(size ? size : 1, a))
+#else
+    if (void* p = std::aligned_alloc(a, (size + a - 1) / a * a))
+#endif
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size, std::align_val_t align)
+{
+    return operator new(size, align);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+void operator delete[](void* p, std::align_val_t align) noexcept
+{
+    operator delete(p, align);
+}
+
+void operator delete(void* p, size_t, std::align_val_t align) noexcept
+{
+    operator delete(p, align);
+}
+
+void operator delete[](void* p, size_t, std::align_val_t align) noexcept
+{
+    operator delete(p, align);
+}
+#endif
@@ -0,0 +1,254 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Handle to a body that stays valid while the body lives, however storage is reordered.
+// `generation` tells a handle to a removed body from one to whatever reused its slot.
+struct BodyHandle
+{
+    static constexpr uint32_t INVALID = std::numeric_limits<uint32_t>::max();
+
+    uint32_t id = INVALID;
+    uint32_t generation = 0;
+
+    bool operator==(const BodyHandle&) const = default;
+};
+
+// Fields tracked for change, combined as a mask
+enum BodyField : unsigned
+{
+    BODY_POSITION = 1u << 0,
+    BODY_VELOCITY = 1u << 1,
+    BODY_MASS = 1u << 2,
+    BODY_RADIUS = 1u << 3,
+    BODY_COLOR = 1u << 4,
+    BODY_ALL = (1u << 5) - 1,
+};
+
+// Massive bodies stored as dense SoA columns with stable handles and per-field dirty bitsets.
+//
+// Writers change columns in place and mark what they touched; consumers (GPU upload, grid, ...)
+// pull the dirty ranges of the fields they read. Bits are kept for one frame: each consumer keeps
+// the `synced()` value of its last pull (0 before the first), and one that missed a frame is
+// handed everything. Pull after the frame's writes, since `endFrame` drops the bits.
+struct BodyRegistry
+{
+    static constexpr size_t FIELD_COUNT = std::bit_width(unsigned(BODY_ALL));
+
+    struct Color
+    {
+        float r, g, b, a;
+    };
+
+    struct Body
+    {
+        float x, y, z;
+        float radius;
+        float mass;
+        Color color;
+        float vx = 0.0f, vy = 0.0f, vz = 0.0f;
+    };
+
+    // Dense columns, reordered by removals
+    std::vector<float> x, y, z;
+    std::vector<float> vx, vy, vz;
+    std::vector<float> mass, radius;
+    std::vector<Color> color;
+    std::vector<uint32_t> handle; // index -> handle id
+
+    // Per handle id
+    std::vector<uint32_t> slot; // handle id -> index, INVALID while free
+    std::vector<uint32_t> generation;
+    std::vector<uint32_t> freeIds;
+
+    std::array<std::vector<uint64_t>, FIELD_COUNT> dirty; // one bit per index
+    uint64_t frame = 1;
+    uint64_t resizedFrame = 0; // last frame the count changed
+
+    size_t size() const
+    {
+        return x.size();
+    }
+
+    BodyHandle add(const Body& b)
+    {
+        uint32_t id;
+        if (freeIds.empty())
+        {
+            id = static_cast<uint32_t>(slot.size());
+            slot.push_back(0);
+            generation.push_back(0);
+        }
+        else
+        {
+            id = freeIds.back();
+            freeIds.pop_back();
+        }
+
+        const size_t i = size();
+        slot[id] = static_cast<uint32_t>(i);
+        x.push_back(b.x);
+        y.push_back(b.y);
+        z.push_back(b.z);
+        vx.push_back(b.vx);
+        vy.push_back(b.vy);
+        vz.push_back(b.vz);
+        mass.push_back(b.mass);
+        radius.push_back(b.radius);
+        color.push_back(b.color);
+        handle.push_back(id);
+
+        for (auto& bits : dirty)
+            bits.resize((size() + 63) / 64);
+        markDirty(BODY_ALL, i);
+        resizedFrame = frame;
+        return {id, generation[id]};
+    }
+
+    bool alive(BodyHandle h) const
+    {
+        return h.id < slot.size() && generation[h.id] == h.generation && slot[h.id] != BodyHandle::INVALID;
+    }
+
+    // Dense index of a live body, INVALID otherwise
+    uint32_t index(BodyHandle h) const
+    {
+        return alive(h) ? slot[h.id] : BodyHandle::INVALID;
+    }
+
+    // Swap-removes the body; the one moved into its place is marked dirty
+    bool remove(BodyHandle h)
+    {
+        if (!alive(h))
+            return false;
+
+        const size_t i = slot[h.id];
+        const size_t last = size() - 1;
+        if (i != last)
+        {
+            x[i] = x[last];
+            y[i] = y[last];
+            z[i] = z[last];
+            vx[i] = vx[last];
+            vy[i] = vy[last];
+            vz[i] = vz[last];
+            mass[i] = mass[last];
+            radius[i] = radius[last];
+            color[i] = color[last];
+            handle[i] = handle[last];
+            slot[handle[i]] = static_cast<uint32_t>(i);
+            markDirty(BODY_ALL, i);
+        }
+        for (auto* col : {&x, &y, &z, &vx, &vy, &vz, &mass, &radius})
+            col->pop_back();
+        color.pop_back();
+        handle.pop_back();
+
+        slot[h.id] = BodyHandle::INVALID;
+        ++generation[h.id];
+        freeIds.push_back(h.id);
+        resizedFrame = frame;
+        return true;
+    }
+
+    void markDirty(unsigned fields, size_t i)
+    {
+        for (size_t f = 0; f < FIELD_COUNT; ++f)
+            if (fields & (1u << f))
+                dirty[f][i / 64] |= uint64_t(1) << (i % 64);
+    }
+
+    void markDirty(unsigned fields, size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+            markDirty(fields, i);
+    }
+
+    // Value for a consumer to store after pulling
+    uint64_t synced() const
+    {
+        return frame;
+    }
+
+    // Whether a consumer that last pulled at `since` can use this frame's bits alone
+    bool incremental(uint64_t since) const
+    {
+        return since != 0 && (since == frame || since + 1 == frame);
+    }
+
+    bool resized(uint64_t since) const
+    {
+        return !incremental(since) || resizedFrame >= since;
+    }
+
+    // Calls fn(begin, end) for each run of indices where any of `fields` changed since `since`
+    template <typename Fn>
+    void forEachChanged(unsigned fields, uint64_t since, Fn&& fn) const
+    {
+        if (!incremental(since))
+        {
+            if (size() > 0)
+                fn(size_t(0), size());
+            return;
+        }
+
+        // Bits past the end are left over from removals
+        auto emit = [&](size_t begin, size_t end)
+        {
+            end = std::min(end, size());
+            if (begin < end)
+                fn(begin, end);
+        };
+        size_t runBegin = 0;
+        bool inRun = false;
+        const size_t words = (size() + 63) / 64;
+        for (size_t w = 0; w < words; ++w)
+        {
+            uint64_t bits = 0;
+            for (size_t f = 0; f < FIELD_COUNT; ++f)
+                if (fields & (1u << f))
+                    bits |= dirty[f][w];
+
+            if (!inRun && bits == 0)
+                continue;
+            if (inRun && bits == ~uint64_t(0))
+                continue;
+            for (size_t b = 0; b < 64; ++b)
+            {
+                const bool set = (bits >> b) & 1;
+                if (set != inRun)
+                {
+                    const size_t i = w * 64 + b;
+                    if (set)
+                        runBegin = i;
+                    else
+                        emit(runBegin, i);
+                    inRun = set;
+                }
+            }
+        }
+        if (inRun)
+            emit(runBegin, size());
+    }
+
+    bool changed(unsigned fields, uint64_t since) const
+    {
+        bool any = false;
+        forEachChanged(fields, since, [&](size_t, size_t) { any = true; });
+        return any;
+    }
+
+    // Drop this frame's dirty bits; consumers that pulled this frame stay incremental
+    void endFrame()
+    {
+        for (auto& bits : dirty)
+            std::fill(bits.begin(), bits.end(), 0);
+        ++frame;
+    }
+};
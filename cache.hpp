@@ -0,0 +1,355 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <list>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+// FNV-1a of `size` bytes, continuing from `hash`
+inline uint64_t fnv1a(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325)
+{
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i)
+        hash = (hash ^ bytes[i]) * 0x100000001b3;
+    return hash;
+}
+
+// A served frame's content address: the camera pose quantized so nearby requests share an entry,
+// the size, and a hash of everything else the trace depends on. Requests are snapped to the pose
+// of their key before tracing, so an entry is exactly the frame its key describes.
+struct FrameKey
+{
+    static constexpr double ANGLE_STEPS = 65536.0; // per turn, about 1e-4 radians
+    static constexpr double RADIUS_STEPS = 4096.0; // per doubling, about 0.017%
+    static constexpr double TURN = 6.283185307179586;
+    static constexpr double MIN_ELEVATION = 0.01; // Camera's, off either pole
+
+    int32_t radius, azimuth, elevation;
+    int32_t width, height, quality;
+    uint64_t scene;
+
+    // Any finite angles: the azimuth is reduced to one turn and the elevation clamped to Camera's
+    // range before they are rounded to steps, so neither overflows int32_t
+    static FrameKey quantize(float radius, float azimuth, float elevation, int width, int height, int quality, uint64_t scene)
+    {
+        const auto steps = [](double angle) { return int32_t(std::lround(angle / TURN * ANGLE_STEPS)); };
+        int32_t turn = steps(std::fmod(double(azimuth), TURN)) % int32_t(ANGLE_STEPS);
+        if (turn < 0)
+            turn += int32_t(ANGLE_STEPS);
+        const double clamped = std::clamp(double(elevation), MIN_ELEVATION, TURN / 2.0 - MIN_ELEVATION);
+        return {int32_t(std::lround(std::log2(radius) * RADIUS_STEPS)), turn, steps(clamped), width, height, quality, scene};
+    }
+
+    float radiusValue() const
+    {
+        return float(std::exp2(radius / RADIUS_STEPS));
+    }
+    float azimuthValue() const
+    {
+        return float(azimuth / ANGLE_STEPS * TURN);
+    }
+    float elevationValue() const
+    {
+        return float(elevation / ANGLE_STEPS * TURN);
+    }
+
+    uint64_t address() const
+    {
+        return fnv1a(this, sizeof(*this));
+    }
+
+    bool operator==(const FrameKey&) const = default;
+};
+static_assert(sizeof(FrameKey) == 32, "FrameKey is hashed as bytes and must have no padding");
+
+// Finished frames by FrameKey, most recently used first: in memory up to a byte budget, and what
+// falls out spilled to files in a directory under a second budget, to be promoted back on a hit.
+// The tiers are exclusive. An entry holds the encoded frame and, if one was traced, its lensing
+// map's encoding after it.
+//
+// The cache does no file I/O on a lookup or an insert, so it can sit on a loop that must not
+// block: entries to spill are left in `spilling` for the caller to write and report back with
+// `spilled`, and a hit on disk is finished by `promote` once the caller has read the file.
+struct FrameCache
+{
+    struct Entry
+    {
+        FrameKey key;
+        std::vector<uint8_t> data; // frame, then lensing map
+        size_t frameBytes = 0;
+
+        size_t lensingBytes() const
+        {
+            return data.size() - frameBytes;
+        }
+    };
+
+    enum class Tier : int32_t
+    {
+        Miss,
+        Memory,
+        Disk,
+    };
+
+    // An entry on its way to disk: `file` is to be written to `path`, a temporary name
+    struct Spill
+    {
+        FrameKey key;
+        std::filesystem::path path;
+        std::vector<std::byte> file;
+    };
+
+    size_t memoryLimit = size_t(256) << 20;
+    size_t diskLimit = size_t(2) << 30;
+
+    uint64_t memoryHits = 0, diskHits = 0, misses = 0;
+    uint64_t spills = 0, drops = 0; // entries moved to disk, and gone for good
+    size_t memoryBytes = 0, diskBytes = 0;
+    std::vector<Spill> spilling; // evicted from memory, in neither tier until `spilled`
+
+    // Spills into `dir` from now on, and indexes the files an earlier run left there
+    void open(const std::filesystem::path& dir)
+    {
+        directory = dir;
+        std::error_code ec;
+        std::filesystem::create_directories(directory, ec);
+        struct Found
+        {
+            std::filesystem::file_time_type used;
+            uint64_t address;
+            size_t bytes;
+        };
+        std::vector<Found> found;
+        for (const auto& file : std::filesystem::directory_iterator(directory, ec))
+        {
+            const std::string name = file.path().filename().string();
+            uint64_t address;
+            if (file.path().extension() == ".part")
+                std::filesystem::remove(file.path(), ec); // a spill cut short
+            else if (file.path().extension() == ".bhc" && std::from_chars(name.data(), name.data() + name.size() - 4, address, 16).ec == std::errc{})
+                found.push_back({file.last_write_time(ec), address, size_t(file.file_size(ec))});
+        }
+        std::sort(found.begin(), found.end(), [](const Found& a, const Found& b) { return a.used < b.used; });
+        for (const Found& f : found)
+            addSpilled(f.address, f.bytes);
+        trimDisk();
+    }
+
+    // The entry for `key`, with a lensing map if `lensing`, now the most recently used; nullptr on
+    // a miss. Also nullptr with `tier` Disk if it was spilled: read spillPath(key) and finish with
+    // `promote`. Valid until the next find, promote or insert.
+    const Entry* find(const FrameKey& key, bool lensing, Tier& tier)
+    {
+        const uint64_t address = key.address();
+        tier = Tier::Miss;
+        if (auto it = memoryIndex.find(address); it != memoryIndex.end())
+        {
+            if (it->second->key == key && (!lensing || it->second->lensingBytes() > 0))
+            {
+                memory.splice(memory.begin(), memory, it->second);
+                ++memoryHits;
+                tier = Tier::Memory;
+                return &memory.front();
+            }
+        }
+        else if (diskIndex.contains(address))
+        {
+            tier = Tier::Disk;
+            return nullptr;
+        }
+        ++misses;
+        return nullptr;
+    }
+
+    // Finishes a find that answered Disk, given the spill file (empty if it could not be read):
+    // the entry moved back into memory, or nullptr on a miss. Valid like find's.
+    const Entry* promote(const FrameKey& key, bool lensing, std::span<const std::byte> file)
+    {
+        const uint64_t address = key.address();
+        Tier tier;
+        if (memoryIndex.contains(address))
+            return find(key, lensing, tier); // promoted by another read, or traced again, meanwhile
+        if (auto spilled = diskIndex.find(address); spilled != diskIndex.end())
+        {
+            Entry entry;
+            if (!parseSpill(file, entry))
+            {
+                removeSpilled(spilled->second); // removed or damaged behind our back
+            }
+            else if (entry.key == key && (!lensing || entry.lensingBytes() > 0))
+            {
+                removeSpilled(spilled->second);
+                insert(std::move(entry));
+                ++diskHits;
+                return &memory.front();
+            }
+        }
+        ++misses;
+        return nullptr;
+    }
+
+    // Files a Spill once the caller wrote it, or drops it if the write failed
+    void spilled(const Spill& spill, bool written)
+    {
+        const uint64_t address = spill.key.address();
+        std::error_code ec;
+        if (memoryIndex.contains(address))
+        {
+            std::filesystem::remove(spill.path, ec); // traced again meanwhile
+            return;
+        }
+        if (written)
+            std::filesystem::rename(spill.path, spillPath(address), ec);
+        if (!written || ec)
+        {
+            std::filesystem::remove(spill.path, ec);
+            ++drops;
+            return;
+        }
+        addSpilled(address, spill.file.size());
+        ++spills;
+        trimDisk();
+    }
+
+    std::filesystem::path spillPath(const FrameKey& key) const
+    {
+        return spillPath(key.address());
+    }
+
+    // Adds or replaces the entry for its key as the most recently used, spilling the least
+    // recently used ones past the memory budget. An entry with a lensing map is not replaced by
+    // one without.
+    void insert(Entry entry)
+    {
+        const uint64_t address = entry.key.address();
+        if (auto it = memoryIndex.find(address); it != memoryIndex.end())
+        {
+            if (it->second->key == entry.key && it->second->lensingBytes() > 0 && entry.lensingBytes() == 0)
+            {
+                memory.splice(memory.begin(), memory, it->second);
+                return;
+            }
+            memoryBytes -= it->second->data.size();
+            memory.erase(it->second);
+            memoryIndex.erase(it);
+        }
+        if (auto spilled = diskIndex.find(address); spilled != diskIndex.end())
+            removeSpilled(spilled->second);
+
+        memoryBytes += entry.data.size();
+        memory.push_front(std::move(entry));
+        memoryIndex[address] = memory.begin();
+        while (memoryBytes > memoryLimit && memory.size() > 1)
+        {
+            Entry& last = memory.back();
+            if (!directory.empty())
+                spilling.push_back(spillOf(last));
+            else
+                ++drops;
+            memoryBytes -= last.data.size();
+            memoryIndex.erase(last.key.address());
+            memory.pop_back();
+        }
+    }
+
+    size_t memoryEntries() const
+    {
+        return memory.size();
+    }
+    size_t diskEntries() const
+    {
+        return disk.size();
+    }
+    double hitRatio() const
+    {
+        const uint64_t lookups = memoryHits + diskHits + misses;
+        return lookups ? double(memoryHits + diskHits) / double(lookups) : 0.0;
+    }
+
+private:
+    struct SpillHeader
+    {
+        char magic[8] = {'B', 'H', 'C', 'A', 'C', 'H', 'E', '1'};
+        FrameKey key;
+        uint64_t frameBytes, lensingBytes;
+    };
+
+    struct Spilled
+    {
+        uint64_t address;
+        size_t bytes;
+    };
+
+    std::filesystem::path directory; // empty: no spill tier
+    std::list<Entry> memory;
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> memoryIndex;
+    std::list<Spilled> disk;
+    std::unordered_map<uint64_t, std::list<Spilled>::iterator> diskIndex;
+
+    std::filesystem::path spillPath(uint64_t address) const
+    {
+        return directory / std::format("{:016x}.bhc", address);
+    }
+
+    void addSpilled(uint64_t address, size_t bytes)
+    {
+        if (auto it = diskIndex.find(address); it != diskIndex.end())
+            removeSpilled(it->second);
+        disk.push_front({address, bytes});
+        diskIndex[address] = disk.begin();
+        diskBytes += bytes;
+    }
+
+    void removeSpilled(std::list<Spilled>::iterator it)
+    {
+        std::error_code ec;
+        std::filesystem::remove(spillPath(it->address), ec);
+        diskBytes -= it->bytes;
+        diskIndex.erase(it->address);
+        disk.erase(it);
+    }
+
+    void trimDisk()
+    {
+        while (diskBytes > diskLimit && disk.size() > 1)
+        {
+            removeSpilled(std::prev(disk.end()));
+            ++drops;
+        }
+    }
+
+    // Under a temporary name until `spilled`, so a killed server never leaves a partial entry
+    Spill spillOf(const Entry& entry) const
+    {
+        const SpillHeader header{.key = entry.key, .frameBytes = entry.frameBytes, .lensingBytes = entry.lensingBytes()};
+        Spill spill{entry.key, spillPath(entry.key.address()), std::vector<std::byte>(sizeof(header) + entry.data.size())};
+        spill.path += ".part";
+        std::memcpy(spill.file.data(), &header, sizeof(header));
+        std::memcpy(spill.file.data() + sizeof(header), entry.data.data(), entry.data.size());
+        return spill;
+    }
+
+    static bool parseSpill(std::span<const std::byte> file, Entry& entry)
+    {
+        SpillHeader header;
+        if (file.size() < sizeof(header))
+            return false;
+        std::memcpy(&header, file.data(), sizeof(header));
+        const size_t bytes = file.size() - sizeof(header);
+        if (std::memcmp(header.magic, SpillHeader{}.magic, sizeof(header.magic)) != 0 || header.frameBytes > bytes || header.lensingBytes != bytes - header.frameBytes)
+            return false;
+        entry.key = header.key;
+        entry.frameBytes = size_t(header.frameBytes);
+        const auto* data = reinterpret_cast<const uint8_t*>(file.data() + sizeof(header));
+        entry.data.assign(data, data + bytes);
+        return true;
+    }
+};
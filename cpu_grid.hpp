@@ -0,0 +1,258 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <span>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define BH_GRID_SSE2 1
+constexpr bool CPU_GRID_SIMD = true;
+#else
+constexpr bool CPU_GRID_SIMD = false;
+#endif
+
+#include "parallel.hpp"
+
+// Spacetime grid warped on the CPU and updated incrementally.
+//
+// Each body's embedding term 2 sqrt(r_s (d - r_s)) - 3e10 is cached per vertex. When a body moves,
+// only the vertices within its influence radius are recomputed. Beyond that radius the term's slope
+// sqrt(r_s / (d - r_s)) is below `slopeTolerance`, so a move of delta shifts them by at most
+// slopeTolerance * delta. That far-field error is tracked per body as accumulated drift, and the
+// body is recomputed everywhere once it could exceed `maxError`.
+//
+// Terms are evaluated a row at a time (4-wide SSE2 where available) with rows spread over a pool.
+struct CpuGrid
+{
+    struct Body
+    {
+        float x, z;
+        float r_s;
+    };
+
+    struct Cached
+    {
+        Body body;
+        float radius;            // influence radius
+        float drift = 0.0f;      // distance moved since the last full recompute
+        std::vector<float> term; // this body's contribution to each vertex
+    };
+
+    // Rows below which a recompute stays on the calling thread
+    static constexpr int PARALLEL_ROWS = 32;
+
+    int cells;
+    float spacing;
+    float slopeTolerance = 0.02f;
+    float maxError; // meters
+
+    std::vector<double> height; // (cells + 1)^2, z-major
+    std::vector<Cached> cache;
+
+    size_t touched = 0;   // vertices recomputed by the last update
+    bool changed = false; // the last update changed any height
+    bool rebuilt = false; // the last update was a full rebuild
+
+    CpuGrid(int gridCells, float gridSpacing)
+        : cells(gridCells)
+        , spacing(gridSpacing)
+        , maxError(0.01f * gridSpacing)
+        , height(size_t(gridCells + 1) * (gridCells + 1))
+    {
+    }
+
+    int side() const
+    {
+        return cells + 1;
+    }
+
+    float coord(int i) const
+    {
+        return (i - cells / 2) * spacing;
+    }
+
+    static float term(float r_s, float dx, float dz)
+    {
+        const float dist = std::sqrt(dx * dx + dz * dz);
+        if (dist > r_s)
+            return 2.0f * std::sqrt(r_s * (dist - r_s)) - 3e10f;
+        return 2.0f * r_s - 3e10f;
+    }
+
+    // Terms of one body for vertices [x0, x1] of a row at depth dz from the body
+    void termRow(const Body& b, float dz, int x0, int x1, float* out) const
+    {
+        int x = x0;
+#ifdef BH_GRID_SSE2
+        const __m128 rs = _mm_set1_ps(b.r_s);
+        const __m128 dz2 = _mm_set1_ps(dz * dz);
+        const __m128 two = _mm_set1_ps(2.0f);
+        const __m128 offset = _mm_set1_ps(3e10f);
+        const __m128 inside = _mm_set1_ps(2.0f * b.r_s - 3e10f);
+        const __m128 bx = _mm_set1_ps(b.x);
+        const __m128 cellSize = _mm_set1_ps(spacing);
+        const __m128 four = _mm_set1_ps(4.0f);
+        // Lattice offsets from the centre column stay exact integers, so lanes match coord()
+        __m128 offsetX = _mm_setr_ps(float(x - cells / 2), float(x + 1 - cells / 2), float(x + 2 - cells / 2), float(x + 3 - cells / 2));
+        for (; x + 3 <= x1; x += 4)
+        {
+            const __m128 dx = _mm_sub_ps(_mm_mul_ps(offsetX, cellSize), bx);
+            const __m128 dist = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), dz2));
+            const __m128 outside = _mm_sub_ps(_mm_mul_ps(two, _mm_sqrt_ps(_mm_mul_ps(rs, _mm_max_ps(_mm_sub_ps(dist, rs), _mm_setzero_ps())))), offset);
+            const __m128 mask = _mm_cmpgt_ps(dist, rs);
+            _mm_storeu_ps(out + (x - x0), _mm_or_ps(_mm_and_ps(mask, outside), _mm_andnot_ps(mask, inside)));
+            offsetX = _mm_add_ps(offsetX, four);
+        }
+#endif
+        for (; x <= x1; ++x)
+            out[x - x0] = term(b.r_s, coord(x) - b.x, dz);
+    }
+
+    // Distance beyond which the slope of the term is below `slopeTolerance`
+    float influenceRadius(float r_s) const
+    {
+        return r_s * (1.0f + 1.0f / (slopeTolerance * slopeTolerance));
+    }
+
+    void update(JobSystem& pool, std::span<const Body> bodies)
+    {
+        touched = 0;
+        changed = false;
+        rebuilt = false;
+
+        bool sameSet = bodies.size() == cache.size();
+        for (size_t i = 0; sameSet && i < bodies.size(); ++i)
+            sameSet = bodies[i].r_s == cache[i].body.r_s;
+        if (!sameSet)
+        {
+            rebuild(pool, bodies);
+            return;
+        }
+
+        for (size_t i = 0; i < bodies.size(); ++i)
+        {
+            Cached& c = cache[i];
+            const Body& b = bodies[i];
+            if (b.x == c.body.x && b.z == c.body.z)
+                continue;
+
+            const Body old = c.body;
+            c.body = b;
+            c.drift += std::hypot(b.x - old.x, b.z - old.z);
+            if (c.drift * slopeTolerance > maxError)
+            {
+                recompute(pool, c, 0, side() - 1, 0, side() - 1);
+                c.drift = 0.0f;
+            }
+            else
+            {
+                // Box around the influence discs at both ends of the move
+                const float r = c.radius;
+                recompute(pool, c, lowIndex(std::min(old.x, b.x) - r), highIndex(std::max(old.x, b.x) + r),
+                          lowIndex(std::min(old.z, b.z) - r), highIndex(std::max(old.z, b.z) + r));
+            }
+        }
+    }
+
+    // Evaluate every body on every vertex, one pass over each row
+    void rebuild(JobSystem& pool, std::span<const Body> bodies)
+    {
+        cache.resize(bodies.size());
+        for (size_t i = 0; i < bodies.size(); ++i)
+        {
+            Cached& c = cache[i];
+            c.body = bodies[i];
+            c.radius = influenceRadius(bodies[i].r_s);
+            c.drift = 0.0f;
+            c.term.resize(height.size());
+        }
+
+        const int n = side();
+        pool.parallelFor(n, [&](size_t begin, size_t end)
+                         {
+                             for (size_t z = begin; z < end; ++z)
+                             {
+                                 double* row = height.data() + z * n;
+                                 std::fill(row, row + n, 0.0);
+                                 for (Cached& c : cache)
+                                 {
+                                     float* t = c.term.data() + z * n;
+                                     termRow(c.body, coord(int(z)) - c.body.z, 0, n - 1, t);
+                                     for (int x = 0; x < n; ++x)
+                                         row[x] += t[x];
+                                 }
+                             } });
+
+        touched = height.size() * cache.size();
+        changed = true;
+        rebuilt = true;
+    }
+
+    int lowIndex(float world) const
+    {
+        return std::clamp(int(std::floor(world / spacing)) + cells / 2, 0, side());
+    }
+
+    int highIndex(float world) const
+    {
+        return std::clamp(int(std::ceil(world / spacing)) + cells / 2, -1, cells);
+    }
+
+    // Replace the body's term on vertices [x0, x1] x [z0, z1]
+    void recompute(JobSystem& pool, Cached& c, int x0, int x1, int z0, int z1)
+    {
+        if (x1 < x0 || z1 < z0)
+            return;
+
+        const int n = side();
+        auto rows = [&](size_t begin, size_t end)
+        {
+            float scratch[256];
+            for (size_t z = begin; z < end; ++z)
+            {
+                const float dz = coord(int(z)) - c.body.z;
+                for (int xs = x0; xs <= x1; xs += 256)
+                {
+                    const int xe = std::min(xs + 255, x1);
+                    termRow(c.body, dz, xs, xe, scratch);
+                    float* t = c.term.data() + z * n;
+                    double* h = height.data() + z * n;
+                    for (int x = xs; x <= xe; ++x)
+                    {
+                        h[x] += double(scratch[x - xs]) - t[x];
+                        t[x] = scratch[x - xs];
+                    }
+                }
+            }
+        };
+        if (z1 - z0 + 1 >= PARALLEL_ROWS)
+            pool.parallelFor(z1 - z0 + 1, [&](size_t begin, size_t end) { rows(z0 + begin, z0 + end); });
+        else
+            rows(z0, z1 + 1);
+
+        touched += size_t(x1 - x0 + 1) * (z1 - z0 + 1);
+        changed = true;
+    }
+
+    // Interleaved xyz positions of every vertex, written straight to `dst` (e.g. a mapped buffer)
+    void writeVertices(JobSystem& pool, float* dst) const
+    {
+        const int n = side();
+        pool.parallelFor(n, [&](size_t begin, size_t end)
+                         {
+                             for (size_t z = begin; z < end; ++z)
+                             {
+                                 float* out = dst + z * n * 3;
+                                 const double* h = height.data() + z * n;
+                                 const float worldZ = coord(int(z));
+                                 for (int x = 0; x < n; ++x)
+                                 {
+                                     out[3 * x + 0] = coord(x);
+                                     out[3 * x + 1] = static_cast<float>(h[x]);
+                                     out[3 * x + 2] = worldZ;
+                                 }
+                             } });
+    }
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// Minimal OpenEXR writer: single part, scanline, uncompressed, 32-bit float channels. Any EXR
+// reader (OpenImageIO, Nuke, Blender, the OpenEXR tools) opens it, and dotted channel names
+// ("disk.radius") show up as layers.
+struct ExrChannel
+{
+    std::string_view name;
+    const float* data;   // the top row
+    size_t stride;       // floats between horizontal neighbours
+    ptrdiff_t rowStride; // floats to the next row down, negative for rows stored bottom-up
+};
+
+// Encodes the image into `out`, replacing its contents
+inline void encodeExr(int width, int height, std::span<const ExrChannel> channels, std::vector<std::byte>& out)
+{
+    // EXR stores channels sorted by name
+    std::vector<const ExrChannel*> sorted;
+    for (const ExrChannel& c : channels)
+        sorted.push_back(&c);
+    std::sort(sorted.begin(), sorted.end(), [](auto* a, auto* b) { return a->name < b->name; });
+
+    out.clear();
+    auto bytes = [&](const void* data, size_t size)
+    {
+        const auto* p = static_cast<const std::byte*>(data);
+        out.insert(out.end(), p, p + size);
+    };
+    auto i32 = [&](int32_t v) { bytes(&v, 4); }; // EXR is little-endian, like every platform we build for
+    auto str = [&](std::string_view s)
+    {
+        bytes(s.data(), s.size());
+        out.push_back(std::byte{0});
+    };
+    auto attribute = [&](std::string_view name, std::string_view type, int32_t size)
+    {
+        str(name);
+        str(type);
+        i32(size);
+    };
+
+    i32(20000630); // magic
+    i32(2);        // version 2, single-part scanline
+
+    int32_t chlistSize = 1;
+    for (auto* c : sorted)
+        chlistSize += int32_t(c->name.size()) + 1 + 16;
+    attribute("channels", "chlist", chlistSize);
+    for (auto* c : sorted)
+    {
+        str(c->name);
+        i32(2); // FLOAT
+        i32(0); // pLinear and reserved
+        i32(1); // x sampling
+        i32(1); // y sampling
+    }
+    out.push_back(std::byte{0});
+
+    attribute("compression", "compression", 1);
+    out.push_back(std::byte{0}); // none
+    for (std::string_view window : {"dataWindow", "displayWindow"})
+    {
+        attribute(window, "box2i", 16);
+        i32(0);
+        i32(0);
+        i32(width - 1);
+        i32(height - 1);
+    }
+    attribute("lineOrder", "lineOrder", 1);
+    out.push_back(std::byte{0}); // increasing y
+    const float one = 1.0f, zero = 0.0f;
+    attribute("pixelAspectRatio", "float", 4);
+    bytes(&one, 4);
+    attribute("screenWindowCenter", "v2f", 8);
+    bytes(&zero, 4);
+    bytes(&zero, 4);
+    attribute("screenWindowWidth", "float", 4);
+    bytes(&one, 4);
+    out.push_back(std::byte{0}); // end of header
+
+    // Offset table, then one block per scanline: y, size, and each channel's row in turn
+    const size_t rowBytes = size_t(width) * 4 * sorted.size();
+    const size_t table = out.size();
+    const size_t first = table + size_t(height) * 8;
+    out.resize(first + size_t(height) * (8 + rowBytes));
+    for (int y = 0; y < height; ++y)
+    {
+        const uint64_t offset = first + size_t(y) * (8 + rowBytes);
+        std::memcpy(out.data() + table + size_t(y) * 8, &offset, 8);
+        std::byte* p = out.data() + offset;
+        const int32_t size = int32_t(rowBytes);
+        std::memcpy(p, &y, 4);
+        std::memcpy(p + 4, &size, 4);
+        p += 8;
+        for (auto* c : sorted)
+        {
+            const float* row = c->data + ptrdiff_t(y) * c->rowStride;
+            for (int x = 0; x < width; ++x, p += 4)
+                std::memcpy(p, row + size_t(x) * c->stride, 4);
+        }
+    }
+}
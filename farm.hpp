@@ -0,0 +1,163 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <span>
+#include <vector>
+
+// Tiles of animation frames rendered by worker processes over TCP (--farm, --worker; net.hpp).
+//
+//   worker       HELLO            coordinator
+//                <- SETUP, then the camera path file's text
+//                <- TILE          the coordinator keeps each worker a few tiles ahead,
+//   RESULT, then the pixels ->    so a worker never waits on a round trip
+//                <- QUIT
+//
+// A worker replays the path's simulation itself, so a tile is only its frame and rectangle.
+enum FarmMessage : uint32_t
+{
+    FARM_HELLO = 1,
+    FARM_SETUP,
+    FARM_TILE,
+    FARM_RESULT,
+    FARM_QUIT,
+};
+
+struct FarmHello
+{
+    char magic[8] = {'B', 'H', 'F', 'A', 'R', 'M', '0', '2'};
+};
+
+struct FarmSetup
+{
+    int32_t width, height;           // output frames
+    int32_t traceWidth, traceHeight; // traced frames, supersampled
+    int32_t tile;                    // largest tile edge
+    uint64_t scene;                  // the coordinator's sceneHash; a worker tracing another refuses
+};
+
+// A rectangle of a traced frame, y from the bottom row up as GL stores it
+struct FarmTile
+{
+    uint32_t id;
+    int32_t frame, x, y, width, height;
+};
+
+// Followed by the tile's RGBA8 rows, bottom-up
+struct FarmResult
+{
+    uint32_t id;
+    float seconds; // tracing and reading back on the worker
+};
+
+// Which tile each worker gets next. Tiles lost with a worker go back to the front of the queue;
+// once the queue is empty, an idle worker takes a second copy of the oldest tile that has run far
+// longer than tiles usually take, and whichever copy comes back first is used. One slow or
+// stalled worker then holds up nothing, at the cost of some duplicated tiles.
+struct FarmScheduler
+{
+    static constexpr int MAX_COPIES = 2;
+    static constexpr double STEAL_FACTOR = 3.0; // times the mean tile latency
+    static constexpr double STEAL_MIN_SECONDS = 0.25;
+
+    enum class State : uint8_t
+    {
+        Pending,
+        Running,
+        Done,
+    };
+
+    struct Tile
+    {
+        FarmTile job;
+        State state = State::Pending;
+        int copies = 0;      // handed out and not yet back or lost
+        double started = 0;  // first copy handed out
+    };
+
+    std::vector<Tile> tiles; // by id
+    std::deque<uint32_t> pending;
+    std::vector<uint32_t> running;
+    double latencySum = 0.0; // handed out to back, of first copies
+    uint64_t completed = 0;
+    uint64_t retries = 0; // tiles requeued after their worker was lost
+    uint64_t steals = 0;  // second copies handed out
+    uint64_t wasted = 0;  // copies that came back after another
+
+    uint32_t add(int frame, int x, int y, int width, int height)
+    {
+        const uint32_t id = uint32_t(tiles.size());
+        tiles.push_back({{id, frame, x, y, width, height}});
+        pending.push_back(id);
+        return id;
+    }
+
+    double meanLatency() const
+    {
+        return completed ? latencySum / double(completed) : 0.0;
+    }
+
+    // The next tile for a worker holding the tiles `held`; false if there is none worth running
+    bool next(double now, std::span<const uint32_t> held, FarmTile& out)
+    {
+        if (!pending.empty())
+        {
+            Tile& t = tiles[pending.front()];
+            pending.pop_front();
+            t.state = State::Running;
+            t.started = now;
+            t.copies = 1;
+            running.push_back(t.job.id);
+            out = t.job;
+            return true;
+        }
+
+        // Nothing queued: back up the oldest straggler this worker is not already running
+        const double late = std::max(STEAL_MIN_SECONDS, STEAL_FACTOR * meanLatency());
+        Tile* oldest = nullptr;
+        for (uint32_t id : running)
+        {
+            Tile& t = tiles[id];
+            if (t.copies < MAX_COPIES && now - t.started > late && std::find(held.begin(), held.end(), id) == held.end() &&
+                (!oldest || t.started < oldest->started))
+                oldest = &t;
+        }
+        if (!oldest || completed == 0)
+            return false;
+        ++oldest->copies;
+        ++steals;
+        out = oldest->job;
+        return true;
+    }
+
+    // A copy came back after `latency` seconds; true if it is the first, to be used
+    bool complete(uint32_t id, double latency)
+    {
+        Tile& t = tiles[id];
+        --t.copies;
+        if (t.state != State::Running)
+        {
+            ++wasted;
+            return false;
+        }
+        t.state = State::Done;
+        std::erase(running, id);
+        latencySum += latency;
+        ++completed;
+        return true;
+    }
+
+    // A worker running a copy of `id` was lost
+    void lost(uint32_t id)
+    {
+        Tile& t = tiles[id];
+        if (--t.copies > 0 || t.state != State::Running)
+            return;
+        t.state = State::Pending;
+        std::erase(running, id);
+        pending.push_front(id);
+        ++retries;
+    }
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+// Bump allocator for data that lives for one frame, usable through std::pmr containers.
+//
+// Allocation only moves an offset; deallocation is a no-op and reset() rewinds everything at the
+// start of the next frame. When a frame outgrows the arena it chains another block, and the next
+// reset() folds the blocks into one big enough for that frame, so after the largest frame has been
+// seen the arena stops touching the heap.
+struct FrameArena : std::pmr::memory_resource
+{
+    struct Block
+    {
+        std::unique_ptr<std::byte[]> data;
+        size_t size = 0;
+    };
+
+    std::vector<Block> blocks;
+    size_t current = 0; // block being bumped
+    size_t offset = 0;  // bytes used in the current block
+    size_t used = 0;    // bytes handed out this frame, including alignment padding
+    size_t peak = 0;    // most bytes any frame used
+
+    explicit FrameArena(size_t initialBytes = size_t(1) << 20)
+    {
+        blocks.push_back({std::make_unique<std::byte[]>(initialBytes), initialBytes});
+    }
+
+    size_t capacity() const
+    {
+        size_t total = 0;
+        for (const auto& b : blocks)
+            total += b.size;
+        return total;
+    }
+
+    // Start a new frame; everything allocated in the previous one becomes invalid
+    void reset()
+    {
+        peak = std::max(peak, used);
+        if (blocks.size() > 1)
+        {
+            const size_t total = capacity();
+            blocks.clear();
+            blocks.push_back({std::make_unique<std::byte[]>(total), total});
+        }
+        current = 0;
+        offset = 0;
+        used = 0;
+    }
+
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        while (true)
+        {
+            Block& b = blocks[current];
+            const size_t start = (offset + alignment - 1) & ~(alignment - 1);
+            if (start + bytes <= b.size)
+            {
+                used += start + bytes - offset;
+                offset = start + bytes;
+                return b.data.get() + start;
+            }
+            if (++current == blocks.size())
+            {
+                const size_t size = std::max(bytes + alignment, 2 * b.size);
+                blocks.push_back({std::make_unique<std::byte[]>(size), size});
+            }
+            offset = 0;
+        }
+    }
+
+    void do_deallocate(void*, size_t, size_t) override
+    {
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+};
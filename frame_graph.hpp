@@ -0,0 +1,174 @@
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <initializer_list>
+#include <type_traits>
+
+#include "alloc_tracker.hpp"
+#include "cache.hpp"
+
+// A frame as a list of stages that declare the resources they read and write.
+//
+// Resources are versioned. Inputs from outside the graph (bodies, tracers, ...) are bumped with
+// `set` or `touch`; a stage that runs bumps its outputs, unless its function returns false to say
+// they did not change. A stage runs only when one of its inputs changed since its last run, or
+// every frame if marked so (it draws into the back buffer, which each swap discards, or it samples
+// something outside). Stages run in the order they were added, which must follow their dependencies.
+struct FrameGraph
+{
+    static constexpr int MAX_RESOURCES = 16;
+    static constexpr int MAX_STAGES = 16;
+    static constexpr int MAX_EDGES = 6;
+
+    using Resource = int;
+
+    struct ResourceState
+    {
+        const char* name;
+        uint64_t version = 1;
+        uint64_t key = 0; // hash of the value last passed to `set`
+        int writer = -1;  // stage writing it, -1 for an input from outside
+    };
+
+    struct Stage
+    {
+        const char* name;
+        bool (*invoke)(void* fn) = nullptr; // false: outputs unchanged
+        void* fn = nullptr;
+        std::array<Resource, MAX_EDGES> inputs{}, outputs{};
+        int inputCount = 0, outputCount = 0;
+        std::array<uint64_t, MAX_EDGES> seen{}; // input versions at the last run, 0 before the first
+        bool always = false;
+
+        // Last frame
+        bool ran = false;
+        const char* reason = nullptr; // the dirty input, "first run" or "every frame"
+        uint64_t runs = 0, skips = 0;
+    };
+
+    std::array<ResourceState, MAX_RESOURCES> resources{};
+    int resourceCount = 0;
+    std::array<Stage, MAX_STAGES> stages{};
+    int stageCount = 0;
+
+    Resource resource(const char* name)
+    {
+        assert(resourceCount < MAX_RESOURCES);
+        resources[resourceCount].name = name;
+        return resourceCount++;
+    }
+
+    // `fn` must outlive the graph
+    template <typename Fn>
+    void stage(const char* name, std::initializer_list<Resource> in, std::initializer_list<Resource> out, Fn& fn, bool always = false)
+    {
+        assert(stageCount < MAX_STAGES && in.size() <= MAX_EDGES && out.size() <= MAX_EDGES);
+        Stage& s = stages[stageCount];
+        s.name = name;
+        s.invoke = [](void* f)
+        {
+            if constexpr (std::is_same_v<std::invoke_result_t<Fn&>, bool>)
+                return (*static_cast<Fn*>(f))();
+            else
+                return (*static_cast<Fn*>(f))(), true;
+        };
+        s.fn = &fn;
+        s.always = always;
+        for (Resource r : in)
+        {
+            assert(resources[r].writer < stageCount && "inputs must be written by an earlier stage");
+            s.inputs[s.inputCount++] = r;
+        }
+        for (Resource r : out)
+        {
+            assert(resources[r].writer == -1 && "a resource has one writer");
+            resources[r].writer = stageCount;
+            s.outputs[s.outputCount++] = r;
+        }
+        ++stageCount;
+    }
+
+    void touch(Resource r)
+    {
+        ++resources[r].version;
+    }
+
+    // Touches `r` if `value` differs from the value last set; T must have no padding
+    template <typename T>
+    void set(Resource r, const T& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        const uint64_t hash = fnv1a(&value, sizeof(T));
+        if (hash != resources[r].key)
+            touch(r);
+        resources[r].key = hash;
+    }
+
+    void execute()
+    {
+        for (int i = 0; i < stageCount; ++i)
+        {
+            Stage& s = stages[i];
+            s.reason = s.always ? "every frame" : nullptr;
+            for (int k = 0; !s.reason && k < s.inputCount; ++k)
+                if (s.seen[k] != resources[s.inputs[k]].version)
+                    s.reason = s.seen[k] == 0 ? "first run" : resources[s.inputs[k]].name;
+
+            s.ran = s.reason != nullptr;
+            if (!s.ran)
+            {
+                ++s.skips;
+                continue;
+            }
+
+            bool changed;
+            {
+                AllocScope scope(s.name);
+                changed = s.invoke(s.fn);
+            }
+            for (int k = 0; k < s.inputCount; ++k)
+                s.seen[k] = resources[s.inputs[k]].version;
+            for (int k = 0; changed && k < s.outputCount; ++k)
+                touch(s.outputs[k]);
+            ++s.runs;
+        }
+    }
+
+    // One bit per stage that ran in the last `execute`
+    uint32_t ranMask() const
+    {
+        uint32_t mask = 0;
+        for (int i = 0; i < stageCount; ++i)
+            mask |= uint32_t(stages[i].ran) << i;
+        return mask;
+    }
+
+    // Nothing but the every-frame stages ran in the last `execute`
+    bool quiet() const
+    {
+        for (int i = 0; i < stageCount; ++i)
+            if (stages[i].ran && !stages[i].always)
+                return false;
+        return true;
+    }
+
+    // "ran: a (why) b (why) | skipped: c d" for the last `execute`, truncated to fit
+    size_t report(char* out, size_t size) const
+    {
+        char* p = out;
+        char* const end = out + size;
+        p = std::format_to_n(p, end - p, "ran:").out;
+        for (int i = 0; i < stageCount; ++i)
+            if (stages[i].ran)
+                p = std::format_to_n(p, end - p, " {} ({})", stages[i].name, stages[i].reason).out;
+        p = std::format_to_n(p, end - p, " | skipped:").out;
+        for (int i = 0; i < stageCount; ++i)
+            if (!stages[i].ran)
+                p = std::format_to_n(p, end - p, " {}", stages[i].name).out;
+        return size_t(p - out);
+    }
+};
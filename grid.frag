@@ -1,5 +1,6 @@
-#version 330 core
-out vec4 FragColor;
-void main() {
-    FragColor = vec4(0.5, 0.5, 0.5, 0.7); // translucent blue lines
-}
+#version 330 core
+in float vFade;
+out vec4 FragColor;
+void main() {
+    FragColor = vec4(0.5, 0.5, 0.5, 0.7 * vFade); // translucent blue lines
+}
@@ -1,6 +1,79 @@
-#version 330 core
-layout(location = 0) in vec3 aPos;
-uniform mat4 viewProj;
-void main() {
-    gl_Position = viewProj * vec4(aPos, 1.0);
-}
+#version 430 core
+layout(location = 0) in vec3 aPos; // warpMode 0: warped world position, otherwise clipmap (i, j, level)
+
+layout(std140, binding = 3) uniform Objects {
+    int numObjects;
+    vec4 objPosRadius[16];
+    vec4 objColor[16];
+    float  mass[16];
+};
+
+uniform mat4 viewProj;
+uniform int warpMode;           // 0: aPos is already warped, 1: Schwarzschild embedding, 2: potential map
+uniform sampler2D potentialMap; // 2 * phi / c^2 over the mesh cube's y = 0 slice
+uniform vec4 potentialRect;     // xy = xz origin, zw = xz extent of potentialMap in meters
+uniform float potentialDepth;   // grid depth where 2 * phi / c^2 = -1
+
+// Clipmap placement, see Engine::uploadClipmapUniforms
+uniform int clipLevels;
+uniform float clipCells;
+uniform float clipSpacing;      // level 0 spacing, doubling per level
+uniform float clipMorph;        // fraction of the way to the next octave of clipSpacing
+uniform vec2 clipOrigin[16];
+
+out float vFade;
+
+const float G = 6.674e-11;
+const float C = 299792458.0;
+
+float schwarzschildHeight(vec2 xz) {
+    // Same embedding as Engine::generateGrid, summed over the objects
+    float y = 0.0;
+    for (int i = 0; i < numObjects; ++i) {
+        float r_s = 2.0 * G * mass[i] / (C * C);
+        float dist = distance(xz, objPosRadius[i].xz);
+        y += (dist > r_s ? 2.0 * sqrt(r_s * (dist - r_s)) : 2.0 * r_s) - 3e10;
+    }
+    return y;
+}
+
+float potentialHeight(vec2 xz) {
+    vec2 size = vec2(textureSize(potentialMap, 0));
+    vec2 uv = (xz - potentialRect.xy) / potentialRect.zw;
+    uv = (uv * (size - 1.0) + 0.5) / size; // texel centres sit on the rect edges
+    return potentialDepth * texture(potentialMap, uv).r;
+}
+
+void main() {
+    if (warpMode == 0) {
+        vFade = 1.0;
+        gl_Position = viewProj * vec4(aPos, 1.0);
+        return;
+    }
+
+    vec2 ij = aPos.xy;
+    int level = int(aPos.z);
+    float centre = 0.5 * clipCells;
+    float edge = max(abs(ij.x - centre), abs(ij.y - centre)) / centre; // 0 at the centre, 1 on the outer rim
+
+    // Odd vertices slide onto the next level's lattice: near each level's rim so it meets the coarser
+    // ring without T-junctions, and across level 0 as the camera zooms towards the next octave
+    float morph = level < clipLevels - 1 ? smoothstep(0.7, 0.95, edge) : 0.0;
+    if (level == 0)
+        morph = max(morph, clipMorph);
+    ij -= fract(ij * 0.5) * 2.0 * morph;
+
+    // The outermost level fades in over the octave and takes over from the one inside it
+    float rim = 1.0 - smoothstep(0.5, 1.0, edge);
+    if (level == clipLevels - 1)
+        vFade = clipMorph * rim;
+    else if (level == clipLevels - 2)
+        vFade = mix(rim, 1.0, clipMorph);
+    else
+        vFade = 1.0;
+
+    float spacing = clipSpacing * exp2(float(level));
+    vec2 xz = clipOrigin[level] + (ij - centre) * spacing;
+    float y = warpMode == 1 ? schwarzschildHeight(xz) : potentialHeight(xz);
+    gl_Position = viewProj * vec4(xz.x, y, xz.y, 1.0);
+}
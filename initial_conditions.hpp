@@ -0,0 +1,206 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <numbers>
+#include <span>
+
+#include "parallel.hpp"
+
+// Initial conditions for massless particles, generated in parallel and reproducible bit for bit.
+//
+// Every particle draws from its own Philox4x32-10 stream keyed by (seed, generator) and counted by
+// (particle index, draw block), so its values depend only on its index, never on which thread or
+// chunk produced it. Units follow the simulation: meters, and meters per step.
+
+// Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3")
+inline std::array<uint32_t, 4> philox4x32(std::array<uint32_t, 4> ctr, std::array<uint32_t, 2> key)
+{
+    constexpr uint32_t M0 = 0xD2511F53, M1 = 0xCD9E8D57;
+    constexpr uint32_t W0 = 0x9E3779B9, W1 = 0xBB67AE85;
+    for (int round = 0; round < 10; ++round)
+    {
+        const uint64_t p0 = uint64_t(M0) * ctr[0];
+        const uint64_t p1 = uint64_t(M1) * ctr[2];
+        ctr = {uint32_t(p1 >> 32) ^ ctr[1] ^ key[0], uint32_t(p1), uint32_t(p0 >> 32) ^ ctr[3] ^ key[1], uint32_t(p0)};
+        key[0] += W0;
+        key[1] += W1;
+    }
+    return ctr;
+}
+
+// Random draws of one particle
+struct PhiloxStream
+{
+    std::array<uint32_t, 2> key;
+    uint64_t index;
+    uint32_t block = 0;
+    std::array<uint32_t, 4> bits{};
+    int used = 4;
+
+    PhiloxStream(uint64_t seed, uint32_t generator, uint64_t particle)
+        : key{uint32_t(seed) ^ generator * 0x85EBCA6Bu, uint32_t(seed >> 32)}
+        , index(particle)
+    {
+    }
+
+    uint32_t next()
+    {
+        if (used == 4)
+        {
+            bits = philox4x32({uint32_t(index), uint32_t(index >> 32), block++, 0}, key);
+            used = 0;
+        }
+        return bits[used++];
+    }
+
+    // [0, 1), 24 bits
+    float uniform()
+    {
+        return float(next() >> 8) * 0x1p-24f;
+    }
+
+    float uniform(float lo, float hi)
+    {
+        return lo + (hi - lo) * uniform();
+    }
+
+    // Standard normal, Box-Muller
+    float normal()
+    {
+        const float r = std::sqrt(-2.0f * std::log(1.0f - uniform()));
+        return r * std::cos(2.0f * std::numbers::pi_v<float> * uniform());
+    }
+
+    // Uniform direction on the unit sphere
+    std::array<float, 3> direction()
+    {
+        const float cosTheta = uniform(-1.0f, 1.0f);
+        const float sinTheta = std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+        const float phi = 2.0f * std::numbers::pi_v<float> * uniform();
+        return {sinTheta * std::cos(phi), cosTheta, sinTheta * std::sin(phi)};
+    }
+};
+
+// Destination columns; a generator fills [0, x.size())
+struct ParticleColumns
+{
+    std::span<float> x, y, z;
+    std::span<float> vx, vy, vz;
+
+    size_t size() const
+    {
+        return x.size();
+    }
+};
+
+// Circular orbits around a central mass in the y = 0 plane, radius uniform in [inner, outer]
+struct KeplerDisk
+{
+    double gm; // G * central mass
+    float innerRadius, outerRadius;
+    float thickness; // heights uniform in [-thickness, thickness]
+};
+
+// Plummer sphere with isotropic velocities (Aarseth, Henon & Wielen 1974), moving as a whole
+struct PlummerSphere
+{
+    double gm; // G * total mass of the sphere
+    float scaleRadius;
+    float maxRadius;         // truncation, a few scale radii
+    float centre[3];         // position of the centre
+    float bulkVelocity[3];   // velocity of the centre
+};
+
+// Stars on near-circular orbits in a ring, with Gaussian radial width and velocity dispersion
+struct StarRing
+{
+    double gm; // G * central mass
+    float radius, width;
+    float dispersion; // per velocity component
+};
+
+// Generator ids, so different generators with the same seed draw unrelated streams
+enum : uint32_t
+{
+    GENERATOR_DISK = 1,
+    GENERATOR_PLUMMER = 2,
+    GENERATOR_RING = 3,
+};
+
+template <typename Fn>
+void generateParticles(JobSystem& pool, ParticleColumns out, uint64_t seed, uint32_t generator, Fn&& particle)
+{
+    pool.parallelFor(out.size(), [&](size_t begin, size_t end)
+                     {
+                         for (size_t i = begin; i < end; ++i)
+                         {
+                             PhiloxStream rng(seed, generator, i);
+                             particle(rng, i);
+                         } });
+}
+
+inline void generateKeplerDisk(JobSystem& pool, const KeplerDisk& disk, uint64_t seed, ParticleColumns out)
+{
+    generateParticles(pool, out, seed, GENERATOR_DISK, [&](PhiloxStream& rng, size_t i)
+                      {
+                          const float r = rng.uniform(disk.innerRadius, disk.outerRadius);
+                          const float angle = 2.0f * std::numbers::pi_v<float> * rng.uniform();
+                          const float speed = static_cast<float>(std::sqrt(disk.gm / r));
+                          out.x[i] = r * std::cos(angle);
+                          out.y[i] = rng.uniform(-disk.thickness, disk.thickness);
+                          out.z[i] = r * std::sin(angle);
+                          out.vx[i] = -std::sin(angle) * speed;
+                          out.vy[i] = 0.0f;
+                          out.vz[i] = std::cos(angle) * speed; });
+}
+
+inline void generatePlummerSphere(JobSystem& pool, const PlummerSphere& sphere, uint64_t seed, ParticleColumns out)
+{
+    const float a = sphere.scaleRadius;
+    const double vScale = std::sqrt(sphere.gm / a);
+    generateParticles(pool, out, seed, GENERATOR_PLUMMER, [&](PhiloxStream& rng, size_t i)
+                      {
+                          // Radius from the inverted cumulative mass, redrawn beyond the truncation
+                          float r;
+                          do
+                          {
+                              const float m = std::max(rng.uniform(), 1e-7f);
+                              r = a / std::sqrt(std::pow(m, -2.0f / 3.0f) - 1.0f);
+                          } while (!(r <= sphere.maxRadius));
+
+                          // Speed as a fraction q of escape speed, rejection-sampled from q^2 (1 - q^2)^(7/2)
+                          float q, g;
+                          do
+                          {
+                              q = rng.uniform();
+                              g = 0.1f * rng.uniform();
+                          } while (g > q * q * std::pow(1.0f - q * q, 3.5f));
+                          const float speed = static_cast<float>(q * std::sqrt(2.0) * vScale * std::pow(1.0 + double(r) * r / (double(a) * a), -0.25));
+
+                          const auto p = rng.direction();
+                          const auto v = rng.direction();
+                          out.x[i] = sphere.centre[0] + r * p[0];
+                          out.y[i] = sphere.centre[1] + r * p[1];
+                          out.z[i] = sphere.centre[2] + r * p[2];
+                          out.vx[i] = sphere.bulkVelocity[0] + speed * v[0];
+                          out.vy[i] = sphere.bulkVelocity[1] + speed * v[1];
+                          out.vz[i] = sphere.bulkVelocity[2] + speed * v[2]; });
+}
+
+inline void generateStarRing(JobSystem& pool, const StarRing& ring, uint64_t seed, ParticleColumns out)
+{
+    generateParticles(pool, out, seed, GENERATOR_RING, [&](PhiloxStream& rng, size_t i)
+                      {
+                          const float r = std::max(ring.radius + ring.width * rng.normal(), 0.01f * ring.radius);
+                          const float angle = 2.0f * std::numbers::pi_v<float> * rng.uniform();
+                          const float speed = static_cast<float>(std::sqrt(ring.gm / r));
+                          out.x[i] = r * std::cos(angle);
+                          out.y[i] = ring.width * 0.1f * rng.normal();
+                          out.z[i] = r * std::sin(angle);
+                          out.vx[i] = -std::sin(angle) * speed + ring.dispersion * rng.normal();
+                          out.vy[i] = ring.dispersion * rng.normal();
+                          out.vz[i] = std::cos(angle) * speed + ring.dispersion * rng.normal(); });
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Single-writer, single-reader triple buffer. The writer fills `back()` and publishes it; the
+// reader takes the most recently published slot with `update()`. Neither side ever waits, and the
+// reader never sees a slot the writer is still filling. States published between two updates are
+// skipped, not queued.
+template <typename T>
+struct TripleBuffer
+{
+    static constexpr uint8_t INDEX = 0x3;
+    static constexpr uint8_t FRESH = 0x4; // the middle slot was published since the reader last took it
+
+    std::array<T, 3> slots{};
+    std::atomic<uint8_t> middle = 1;
+    uint8_t backIndex = 0;  // writer's
+    uint8_t frontIndex = 2; // reader's
+
+    // Writer side
+    T& back()
+    {
+        return slots[backIndex];
+    }
+
+    void publish()
+    {
+        backIndex = middle.exchange(backIndex | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    // Reader side: true if a newer state was taken
+    bool update()
+    {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH))
+            return false;
+        frontIndex = middle.exchange(frontIndex, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+
+    const T& front() const
+    {
+        return slots[frontIndex];
+    }
+};
+
+// Bounded single-producer, single-consumer ring. `push` fails rather than blocks when full.
+template <typename T, size_t Capacity>
+struct SpscQueue
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+    std::array<T, Capacity> items{};
+    alignas(64) std::atomic<size_t> head = 0; // next to pop, written by the consumer
+    alignas(64) std::atomic<size_t> tail = 0; // next to push, written by the producer
+
+    bool push(const T& item)
+    {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == Capacity)
+            return false;
+        items[t & (Capacity - 1)] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item)
+    {
+        const size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+            return false;
+        item = items[h & (Capacity - 1)];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+};
@@ -1,19 +1,65 @@
 #include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
 #include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <filesystem>
 #include <format>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
 #include <numbers>
+#include <numeric>
+#include <random>
+#include <span>
 #include <sstream>
+#include <string_view>
+#include <thread>
 #include <vector>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#ifdef __linux__
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <spawn.h>
+#include <sys/wait.h>
+extern char** environ;
+#endif
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "alloc_tracker.hpp"
+#include "body_registry.hpp"
+#include "cache.hpp"
+#include "cpu_grid.hpp"
+#include "exr.hpp"
+#include "farm.hpp"
+#include "frame_arena.hpp"
+#include "frame_graph.hpp"
+#include "initial_conditions.hpp"
+#include "lockfree.hpp"
+#include "morton.hpp"
+#include "net.hpp"
+#include "parallel.hpp"
+#include "particle_mesh.hpp"
+#include "perf_counter.hpp"
+#include "qoi.hpp"
+#include "serve.hpp"
+#include "snapshot.hpp"
+#include "tasks.hpp"
+#include "video.hpp"
+
 #ifdef _WIN32
 extern "C" // Export symbols to request high-performance GPU
 {
@@ -22,15 +68,18 @@ extern "C" // Export symbols to request high-performance GPU
 }
 #endif
 
-using glm::vec3, glm::vec4, glm::mat4;
+using glm::vec2, glm::vec3, glm::vec4, glm::mat4;
 
 // Constants
 constexpr float PI = std::numbers::pi_v<float>;
 constexpr double C = 299'792'458.0;
 constexpr double G = 6.674'30e-11;
 
-// Global state
-bool g_gravity = false;
+enum class Solver
+{
+    Direct,       // pairwise sums over the massive bodies
+    ParticleMesh, // P3M: FFT mesh for long range, direct sum for short range
+};
 
 struct Camera
 {
@@ -89,7 +138,7 @@ struct Camera
         update();
     }
 
-    void processMouseButton(int button, int action, int mods, GLFWwindow* win)
+    void processMouseButton(int button, int action, double cursorX, double cursorY)
     {
         if (button == GLFW_MOUSE_BUTTON_LEFT || button == GLFW_MOUSE_BUTTON_MIDDLE)
         {
@@ -98,7 +147,8 @@ struct Camera
                 dragging = true;
                 // Disable panning so camera always orbits center
                 panning = false;
-                glfwGetCursorPos(win, &lastX, &lastY);
+                lastX = cursorX;
+                lastY = cursorY;
             }
             else if (action == GLFW_RELEASE)
             {
@@ -106,17 +156,6 @@ struct Camera
                 panning = false;
             }
         }
-        if (button == GLFW_MOUSE_BUTTON_RIGHT)
-        {
-            if (action == GLFW_PRESS)
-            {
-                g_gravity = true;
-            }
-            else if (action == GLFW_RELEASE)
-            {
-                g_gravity = false;
-            }
-        }
     }
 
     void processScroll(double xoffset, double yoffset)
@@ -126,17 +165,41 @@ struct Camera
         update();
     }
 
-    void processKey(int key, int scancode, int action, int mods)
+};
+
+// Raw GLFW input. The callbacks forward every event to both the renderer and the simulation
+// thread through SPSC queues, and each side acts on the events it cares about.
+struct InputEvent
+{
+    enum class Type : uint8_t
     {
-        if (action == GLFW_PRESS && key == GLFW_KEY_G)
-        {
-            g_gravity = !g_gravity;
-            std::cout << "[INFO] Gravity turned " << (g_gravity ? "ON" : "OFF") << '\n';
-        }
-    }
+        MouseButton,
+        MouseMove,
+        Scroll,
+        Key,
+    };
+
+    Type type = Type::Key;
+    int code = 0; // button or key
+    int action = 0;
+    double x = 0.0, y = 0.0; // cursor position, or scroll offsets
+    double time = 0.0;       // glfwGetTime() when the callback fired
 };
 
-Camera camera;
+using InputQueue = SpscQueue<InputEvent, 256>;
+
+struct InputRouting
+{
+    InputQueue render;
+    InputQueue* simulation = nullptr;
+
+    // A full queue drops the event: it only fills if its consumer stalls for hundreds of events
+    void push(const InputEvent& e)
+    {
+        render.push(e);
+        simulation->push(e);
+    }
+};
 
 struct BlackHole
 {
@@ -172,7 +235,8 @@ struct ObjectData
     vec3 velocity = vec3(0.0f);
 };
 
-std::vector<ObjectData> objects = {
+// Initial scene, loaded into the registry below
+const std::vector<ObjectData> sceneObjects = {
     {vec4(4e11f, 0.0f, 0.0f, 4e10f), vec4(1, 1, 1, 1), 1e30f},
     {vec4(0.0f, 0.0f, 4e11f, 4e10f), vec4(1, 0, 0, 1), 1e30f},
     {vec4(-4e11f, 0.0f, 0.0f, 4e10f), vec4(0, 1, 0, 1), 1e30f},
@@ -180,6 +244,746 @@ std::vector<ObjectData> objects = {
     {vec4(0.0f, 0.0f, 0.0f, static_cast<float>(SagA.r_s)), vec4(0, 0, 0, 1), static_cast<float>(SagA.mass)},
 };
 
+// Massive bodies as simulated: SoA columns with stable handles and per-field change tracking.
+// Owned by the Simulation thread once it starts; the renderer reads published copies.
+BodyRegistry objects;
+
+void addObjects(BodyRegistry& registry, const std::vector<ObjectData>& list)
+{
+    for (const auto& obj : list)
+        registry.add({obj.posRadius.x, obj.posRadius.y, obj.posRadius.z, obj.posRadius.w, obj.mass,
+                      {obj.color.x, obj.color.y, obj.color.z, obj.color.w},
+                      obj.velocity.x, obj.velocity.y, obj.velocity.z});
+}
+
+// Massless test particles (debris, stars, probes) stored as SoA.
+// They feel the field of the massive `objects` but never source gravity.
+// Columns are reordered for locality, so outside code refers to a tracer by its handle.
+struct Tracers
+{
+    std::vector<float> x, y, z;
+    std::vector<float> vx, vy, vz;
+    std::vector<uint32_t> handle; // index -> handle
+    std::vector<uint32_t> slot;   // handle -> index
+
+    size_t size() const
+    {
+        return x.size();
+    }
+
+    uint32_t add(vec3 pos, vec3 vel)
+    {
+        const auto h = static_cast<uint32_t>(size());
+        x.push_back(pos.x);
+        y.push_back(pos.y);
+        z.push_back(pos.z);
+        vx.push_back(vel.x);
+        vy.push_back(vel.y);
+        vz.push_back(vel.z);
+        handle.push_back(h);
+        slot.push_back(h);
+        return h;
+    }
+
+    // Replace the contents with `count` tracers for a generator to fill, handles in index order
+    void resize(size_t count)
+    {
+        for (auto* col : {&x, &y, &z, &vx, &vy, &vz})
+            col->resize(count);
+        handle.resize(count);
+        slot.resize(count);
+        std::iota(handle.begin(), handle.end(), 0u);
+        std::iota(slot.begin(), slot.end(), 0u);
+    }
+
+    ParticleColumns columns()
+    {
+        return {x, y, z, vx, vy, vz};
+    }
+
+    vec3 position(uint32_t h) const
+    {
+        const uint32_t i = slot[h];
+        return vec3(x[i], y[i], z[i]);
+    }
+};
+
+constexpr size_t NUM_TRACERS = 1'000'000;
+
+Tracers tracers; // owned by the Simulation thread once it starts, like `objects`
+
+// Every parallel loop runs here, from the render and simulation threads alike
+JobSystem pool;
+
+// Per-worker job statistics since the last report; "outside" is the deque shared by the render
+// and simulation threads
+void printJobStats(JobSystem& jobs)
+{
+    AllocScope scope("job stats", true); // on request
+    std::cout << "\n[PERF] Jobs since last report:\n";
+    for (size_t i = 0; i < jobs.queues.size(); ++i)
+    {
+        const JobSystem::WorkerStats s = jobs.stats(i);
+        const std::string name = i + 1 < jobs.queues.size() ? std::format("worker {}", i) : "outside";
+        std::cout << std::format("  {:>9}: {:>8} jobs, {:>6} steals ({} missed), depth {} (max {}), idle {:.2f} s\n",
+                                 name, s.jobs, s.steals, s.failedSteals, s.depth, s.maxDepth, s.idleSeconds);
+    }
+    jobs.resetStats();
+}
+
+// Initial tracer swarms, chosen with --scene
+enum class Scene
+{
+    Disk,    // circular orbits around SagA in a thin sheet around the disk plane
+    Plummer, // a star cluster on a circular orbit around SagA
+    Ring,    // a ring of stars with some velocity dispersion
+};
+
+// Same seed, same swarm, whatever the thread count
+void seedTracers(Tracers& t, size_t count, Scene scene = Scene::Disk, uint64_t seed = 42)
+{
+    t.resize(count);
+    const double gm = G * SagA.mass;
+    switch (scene)
+    {
+    case Scene::Disk:
+        generateKeplerDisk(pool, {gm, 1.5e11f, 6e11f, 5e9f}, seed, t.columns());
+        break;
+    case Scene::Plummer:
+    {
+        const float orbit = 3e11f;
+        const float speed = static_cast<float>(std::sqrt(gm / orbit));
+        generatePlummerSphere(pool, {G * 1e34, 1e10f, 1e11f, {orbit, 0.0f, 0.0f}, {0.0f, 0.0f, speed}}, seed, t.columns());
+        break;
+    }
+    case Scene::Ring:
+        generateStarRing(pool, {gm, 3e11f, 1.5e10f, 1e6f}, seed, t.columns());
+        break;
+    }
+}
+
+// Scratch that lives for one render frame, rewound at the top of the loop
+FrameArena frameArena;
+// Scratch that lives for one simulation step (accelerations, flattened sources)
+FrameArena stepArena;
+
+// Gravity steps between Morton re-sorts of the tracer columns
+constexpr int SORT_INTERVAL = 256;
+
+MortonSorter sorter;
+
+// Reorder tracers along a Z-order curve so that spatial neighbours are memory neighbours
+void sortTracers(Tracers& t)
+{
+    static std::vector<float> floatScratch;
+    static std::vector<uint32_t> handleScratch;
+
+    sorter.sort(pool, t.x, t.y, t.z);
+
+    // The float columns and the handle -> slot chain are independent; run them side by side
+    auto permuteFloats = [&]
+    {
+        for (auto* col : {&t.x, &t.y, &t.z, &t.vx, &t.vy, &t.vz})
+            sorter.permute(pool, *col, floatScratch);
+    };
+    auto permuteHandles = [&] { sorter.permute(pool, t.handle, handleScratch); };
+    auto rebuildSlots = [&]
+    {
+        pool.parallelFor(t.size(), [&](size_t begin, size_t end)
+                         {
+                             for (size_t i = begin; i < end; ++i)
+                                 t.slot[t.handle[i]] = static_cast<uint32_t>(i); });
+    };
+    JobCounter handles, done;
+    pool.run(handles, permuteHandles);
+    pool.after(handles, done, rebuildSlots);
+    pool.run(done, permuteFloats);
+    pool.wait(done);
+    pool.wait(handles);
+}
+
+// Gravity steps between checkpoints when --checkpoint is given
+constexpr uint64_t CHECKPOINT_INTERVAL = 4096;
+
+// Snapshot columns of the simulation state. Handles of massive bodies are not kept: a restored
+// registry hands out fresh ones in stored order. Tracer handles are, with their slots.
+std::array<SnapshotColumnRef, 17> snapshotColumns(const BodyRegistry& b, const Tracers& t)
+{
+    return {
+        snapshotColumn<float>("body.x", b.x),
+        snapshotColumn<float>("body.y", b.y),
+        snapshotColumn<float>("body.z", b.z),
+        snapshotColumn<float>("body.vx", b.vx),
+        snapshotColumn<float>("body.vy", b.vy),
+        snapshotColumn<float>("body.vz", b.vz),
+        snapshotColumn<float>("body.mass", b.mass),
+        snapshotColumn<float>("body.radius", b.radius),
+        snapshotColumn<BodyRegistry::Color>("body.color", b.color),
+        snapshotColumn<float>("tracer.x", t.x),
+        snapshotColumn<float>("tracer.y", t.y),
+        snapshotColumn<float>("tracer.z", t.z),
+        snapshotColumn<float>("tracer.vx", t.vx),
+        snapshotColumn<float>("tracer.vy", t.vy),
+        snapshotColumn<float>("tracer.vz", t.vz),
+        snapshotColumn<uint32_t>("tracer.handle", t.handle),
+        snapshotColumn<uint32_t>("tracer.slot", t.slot),
+    };
+}
+
+// Load bodies and tracers from a snapshot; `step` gets the step count it was taken at
+bool restoreSnapshot(const std::filesystem::path& path, BodyRegistry& b, Tracers& t, uint64_t& step)
+{
+    MappedSnapshot snap(path);
+    if (!snap.valid())
+        return false;
+
+    const auto bx = snap.column<const float>("body.x"), by = snap.column<const float>("body.y"), bz = snap.column<const float>("body.z");
+    const auto bvx = snap.column<const float>("body.vx"), bvy = snap.column<const float>("body.vy"), bvz = snap.column<const float>("body.vz");
+    const auto mass = snap.column<const float>("body.mass"), radius = snap.column<const float>("body.radius");
+    const auto color = snap.column<const BodyRegistry::Color>("body.color");
+    const size_t bodies = bx.size();
+    for (auto col : {by, bz, bvx, bvy, bvz, mass, radius})
+        if (col.size() != bodies)
+            return false;
+    if (color.size() != bodies)
+        return false;
+
+    const size_t n = snap.column<const float>("tracer.x").size();
+    Tracers restored;
+    bool ok = true;
+    for (auto [name, col] : {std::pair{"tracer.x", &restored.x}, {"tracer.y", &restored.y}, {"tracer.z", &restored.z},
+                             {"tracer.vx", &restored.vx}, {"tracer.vy", &restored.vy}, {"tracer.vz", &restored.vz}})
+        ok = ok && restoreColumn(pool, snap.column<const float>(name), *col, n);
+    ok = ok && restoreColumn(pool, snap.column<const uint32_t>("tracer.handle"), restored.handle, n);
+    ok = ok && restoreColumn(pool, snap.column<const uint32_t>("tracer.slot"), restored.slot, n);
+    // Slots are indexed by handle: each handle in range and its slot pointing back at it makes
+    // both columns permutations of [0, n) and inverses of each other
+    for (size_t i = 0; ok && i < n; ++i)
+        ok = restored.handle[i] < n && restored.slot[restored.handle[i]] == i;
+    if (!ok)
+        return false;
+
+    b = BodyRegistry();
+    for (size_t i = 0; i < bodies; ++i)
+        b.add({bx[i], by[i], bz[i], radius[i], mass[i], color[i], bvx[i], bvy[i], bvz[i]});
+    t = std::move(restored);
+    step = snap.header().step;
+    return true;
+}
+
+// Time and cache misses of one gravity step
+struct KernelSample
+{
+    double seconds = 0.0;
+    uint64_t cacheMisses = 0;
+    size_t items = 0;
+
+    double nsPerItem() const
+    {
+        return items ? seconds * 1e9 / items : 0.0;
+    }
+
+    double missesPerItem() const
+    {
+        return items ? double(cacheMisses) / items : 0.0;
+    }
+};
+
+// 32^3 mesh over +-6e11 m covers the stars and the tracer swarm
+ParticleMesh pm(32, 6e11f, G);
+
+// Grid depth in meters where 2 * phi / c^2 = -1, i.e. at a Schwarzschild radius
+constexpr double POTENTIAL_DEPTH = 1.5e11;
+constexpr int POTENTIAL_MAP_SIZE = 256;
+
+// 2 * phi / c^2 of a mesh solution over the y = 0 slice of its cube, on a square lattice whose
+// outer samples sit on the cube's edges. What the renderer needs of the field.
+struct PotentialSlice
+{
+    std::vector<float> values; // size^2, x fastest
+    int size = 0;
+    float origin = 0.0f, extent = 0.0f;
+    unsigned version = 0; // ParticleMesh::version sampled, 0 for none
+
+    void sample(JobSystem& pool, const ParticleMesh& field, int samples)
+    {
+        size = samples;
+        values.resize(size_t(size) * size);
+        origin = -field.half;
+        extent = 2.0f * field.half;
+        const float step = extent / (size - 1);
+        pool.parallelFor(size, [&](size_t begin, size_t end)
+                         {
+                             for (size_t z = begin; z < end; ++z)
+                                 for (int x = 0; x < size; ++x)
+                                 {
+                                     const double phi = field.potential(origin + x * step, 0.0f, origin + z * step);
+                                     values[z * size + x] = static_cast<float>(2.0 * phi / (C * C));
+                                 } });
+        version = field.version;
+    }
+
+    // Bilinear, clamped to the slice
+    float at(float x, float z) const
+    {
+        const float u = std::clamp((x - origin) / extent, 0.0f, 1.0f) * (size - 1);
+        const float v = std::clamp((z - origin) / extent, 0.0f, 1.0f) * (size - 1);
+        const int i = std::min(int(u), size - 2), j = std::min(int(v), size - 2);
+        const float fu = u - i, fv = v - j;
+        const float* row = values.data() + size_t(j) * size + i;
+        return (row[0] * (1.0f - fu) + row[1] * fu) * (1.0f - fv) + (row[size] * (1.0f - fu) + row[size + 1] * fu) * fv;
+    }
+};
+
+// Snapshot the massive bodies' columns as mesh sources and solve the mesh. The copy keeps the
+// sources at the positions the field was solved for while the registry moves on.
+void solveMesh(ParticleMesh& pm, const BodyRegistry& objects)
+{
+    static std::vector<float> x, y, z, mass, radius;
+    x.assign(objects.x.begin(), objects.x.end());
+    y.assign(objects.y.begin(), objects.y.end());
+    z.assign(objects.z.begin(), objects.z.end());
+    mass.assign(objects.mass.begin(), objects.mass.end());
+    radius.assign(objects.radius.begin(), objects.radius.end());
+    pm.solve({x, y, z, mass, radius});
+}
+
+void stepGravityMesh(BodyRegistry& objects, Tracers& tracers)
+{
+    std::pmr::vector<float> ax(&stepArena), ay(&stepArena), az(&stepArena);
+
+    solveMesh(pm, objects);
+
+    // Massive bodies are the mesh sources themselves
+    ax.resize(objects.size());
+    ay.resize(objects.size());
+    az.resize(objects.size());
+    pm.accelerations(pm.sources.x, pm.sources.y, pm.sources.z, ax, ay, az, true);
+    for (size_t i = 0; i < objects.size(); ++i)
+    {
+        objects.vx[i] += ax[i];
+        objects.vy[i] += ay[i];
+        objects.vz[i] += az[i];
+        objects.x[i] += objects.vx[i];
+        objects.y[i] += objects.vy[i];
+        objects.z[i] += objects.vz[i];
+    }
+    objects.markDirty(BODY_POSITION | BODY_VELOCITY, 0, objects.size());
+
+    // Tracers: each range reads the solved mesh and writes only its own entries
+    const size_t n = tracers.size();
+    ax.resize(n);
+    ay.resize(n);
+    az.resize(n);
+    pool.parallelFor(n, [&](size_t begin, size_t end)
+                     {
+                         const size_t count = end - begin;
+                         pm.accelerations(std::span(tracers.x).subspan(begin, count), std::span(tracers.y).subspan(begin, count),
+                                          std::span(tracers.z).subspan(begin, count), std::span(ax).subspan(begin, count),
+                                          std::span(ay).subspan(begin, count), std::span(az).subspan(begin, count), false);
+                         for (size_t i = begin; i < end; ++i)
+                         {
+                             tracers.vx[i] += ax[i];
+                             tracers.vy[i] += ay[i];
+                             tracers.vz[i] += az[i];
+                             tracers.x[i] += tracers.vx[i];
+                             tracers.y[i] += tracers.vy[i];
+                             tracers.z[i] += tracers.vz[i];
+                         } });
+}
+
+void stepGravity(BodyRegistry& objects, Tracers& tracers, Solver solver)
+{
+    if (solver == Solver::ParticleMesh)
+    {
+        stepGravityMesh(objects, tracers);
+        return;
+    }
+    pm.solved = false; // bodies move under the direct solver, the mesh field goes stale
+
+    // Massive bodies: O(N^2) over the few gravity sources
+    const size_t count = objects.size();
+    for (size_t i = 0; i < count; ++i)
+    {
+        const vec3 pos(objects.x[i], objects.y[i], objects.z[i]);
+        vec3 totalAcc(0.0f);
+        for (size_t j = 0; j < count; ++j)
+        {
+            if (i == j)
+                continue;
+
+            vec3 delta = vec3(objects.x[j], objects.y[j], objects.z[j]) - pos;
+            float distance = glm::length(delta);
+
+            if (distance > 0.0f)
+            {
+                vec3 direction = delta / distance;
+                double force = (G * objects.mass[i] * objects.mass[j]) / (distance * distance);
+                totalAcc += direction * float(force / objects.mass[i]);
+            }
+        }
+
+        objects.vx[i] += totalAcc.x;
+        objects.vy[i] += totalAcc.y;
+        objects.vz[i] += totalAcc.z;
+        objects.x[i] += objects.vx[i];
+        objects.y[i] += objects.vy[i];
+        objects.z[i] += objects.vz[i];
+    }
+    objects.markDirty(BODY_POSITION | BODY_VELOCITY, 0, count);
+
+    // Tracers: O(N_tracers x N_massive) across the job system, sources flattened once per step
+    struct Source
+    {
+        float x, y, z;
+        float gm;      // G * mass
+        float radius2; // no pull inside the body, keeps captured tracers finite
+    };
+    std::pmr::vector<Source> sources(&stepArena);
+    sources.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const float r = objects.radius[i];
+        sources.push_back({objects.x[i], objects.y[i], objects.z[i], static_cast<float>(G * objects.mass[i]), r * r});
+    }
+
+    pool.parallelFor(tracers.size(), [&](size_t begin, size_t end)
+                     {
+                         for (size_t i = begin; i < end; ++i)
+                         {
+                             float ax = 0.0f, ay = 0.0f, az = 0.0f;
+                             for (const auto& s : sources)
+                             {
+                                 const float dx = s.x - tracers.x[i];
+                                 const float dy = s.y - tracers.y[i];
+                                 const float dz = s.z - tracers.z[i];
+                                 const float dist2 = dx * dx + dy * dy + dz * dz;
+                                 if (dist2 > s.radius2)
+                                 {
+                                     const float invDist = 1.0f / std::sqrt(dist2);
+                                     const float a = s.gm * invDist * invDist * invDist;
+                                     ax += dx * a;
+                                     ay += dy * a;
+                                     az += dz * a;
+                                 }
+                             }
+
+                             tracers.vx[i] += ax;
+                             tracers.vy[i] += ay;
+                             tracers.vz[i] += az;
+                             tracers.x[i] += tracers.vx[i];
+                             tracers.y[i] += tracers.vy[i];
+                             tracers.z[i] += tracers.vz[i];
+                         } });
+}
+
+// One published simulation step: everything the renderer reads of the simulation
+struct SimState
+{
+    BodyRegistry bodies;        // with the dirty bits of the step that produced it
+    std::vector<float> x, y, z; // tracer positions
+    uint64_t tracerVersion = 0; // changes whenever the tracer columns do
+    PotentialSlice potential;   // of the mesh solution, while `solver` is ParticleMesh
+    Solver solver = Solver::Direct;
+    bool gravity = false;
+    uint64_t step = 0;
+    double stepSeconds = 0.0; // last gravity step
+};
+
+// Integrates `objects` and `tracers`, which it owns once started, on its own thread at up to
+// RATE steps per second. Each step is published through a triple buffer, so the renderer reads
+// the latest complete state without waiting and neither side slows the other down.
+struct Simulation
+{
+    static constexpr double RATE = 60.0;
+
+    TripleBuffer<SimState> states;
+    InputQueue input;
+    std::atomic<bool> quit = false;
+    std::thread thread;
+
+    // Simulation thread only
+    bool gravity = false;
+    Solver solver = Solver::Direct;
+    uint64_t steps = 0;
+    uint64_t tracerVersion = 1;
+    double stepSeconds = 0.0;
+    PotentialSlice potential;
+    CheckpointWriter* checkpoint = nullptr;
+    KernelSample beforeSort;
+    double sortSeconds = 0.0;
+    bool reportSort = false;
+    bool changed = false; // the next published state differs from the last
+
+    ~Simulation()
+    {
+        stop();
+    }
+
+    void start(uint64_t startStep, CheckpointWriter* writer)
+    {
+        steps = startStep;
+        checkpoint = writer;
+        publish(); // the renderer has a state from the first frame on
+        thread = std::thread([this] { run(); });
+    }
+
+    void stop()
+    {
+        quit = true;
+        if (thread.joinable())
+            thread.join();
+    }
+
+    void run()
+    {
+        // Both solvers run their loops across the pool, so the workers are counted with this thread
+        std::vector<int> workers;
+        for (const auto& id : pool.threadIds)
+            if (const int tid = id.load(std::memory_order_relaxed))
+                workers.push_back(tid);
+        CacheMissGroup gravityCounter(workers);
+        const auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / RATE));
+        auto next = std::chrono::steady_clock::now();
+        while (!quit)
+        {
+            InputEvent e;
+            while (input.pop(e))
+                handle(e);
+            step(gravityCounter);
+            publish();
+            if (std::exchange(changed, false))
+                glfwPostEmptyEvent(); // wakes a renderer waiting in glfwWaitEvents
+
+            // Fixed rate; a step that overruns is not made up for
+            next += period;
+            const auto now = std::chrono::steady_clock::now();
+            if (next < now)
+                next = now;
+            std::this_thread::sleep_until(next);
+        }
+    }
+
+    void handle(const InputEvent& e)
+    {
+        const bool wasGravity = gravity;
+        const Solver wasSolver = solver;
+        if (e.type == InputEvent::Type::Key && e.action == GLFW_PRESS && e.code == GLFW_KEY_G)
+        {
+            gravity = !gravity;
+            std::cout << "\n[INFO] Gravity turned " << (gravity ? "ON" : "OFF") << '\n';
+        }
+        if (e.type == InputEvent::Type::Key && e.action == GLFW_PRESS && e.code == GLFW_KEY_M)
+        {
+            solver = solver == Solver::Direct ? Solver::ParticleMesh : Solver::Direct;
+            std::cout << "\n[INFO] Gravity solver: " << (solver == Solver::Direct ? "direct" : "particle-mesh") << '\n';
+        }
+        if (e.type == InputEvent::Type::MouseButton && e.code == GLFW_MOUSE_BUTTON_RIGHT && e.action != GLFW_REPEAT)
+            gravity = e.action == GLFW_PRESS; // hold for gravity
+        changed |= gravity != wasGravity || solver != wasSolver;
+    }
+
+    void step(CacheMissGroup& gravityCounter)
+    {
+        stepArena.reset();
+        if (gravity)
+        {
+            AllocScope scope("gravity");
+            gravityCounter.start();
+            auto start = std::chrono::steady_clock::now();
+            stepGravity(objects, tracers, solver);
+            stepSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            changed = true;
+            const KernelSample sample = {stepSeconds, gravityCounter.stop(), objects.size() + tracers.size()};
+            ++tracerVersion;
+
+            // Compare the step before a re-sort with the one after it
+            if (reportSort)
+            {
+                char line[160];
+                auto out = std::format_to_n(line, sizeof(line), "\n[PERF] Morton re-sort ({:.1f} ms): gravity {:.1f} -> {:.1f} ns/body",
+                                            sortSeconds * 1e3, beforeSort.nsPerItem(), sample.nsPerItem()).out;
+                if (gravityCounter.available())
+                    out = std::format_to_n(out, line + sizeof(line) - out, ", {:.3f} -> {:.3f} cache misses/body",
+                                           beforeSort.missesPerItem(), sample.missesPerItem()).out;
+                std::cout.write(line, out - line) << '\n';
+                reportSort = false;
+            }
+            if (++steps % SORT_INTERVAL == 0)
+            {
+                beforeSort = sample;
+                start = std::chrono::steady_clock::now();
+                sortTracers(tracers);
+                sortSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                reportSort = true;
+            }
+            if (checkpoint && steps % CHECKPOINT_INTERVAL == 0)
+            {
+                AllocScope checkpointScope("checkpoint capture");
+                checkpoint->capture(pool, steps, snapshotColumns(objects, tracers));
+            }
+        }
+
+        CheckpointWriter::Result saved;
+        if (checkpoint && checkpoint->takeResult(saved))
+        {
+            char line[160];
+            const auto out = std::format_to_n(line, sizeof(line), "\n[INFO] Checkpoint of step {} {} ({:.1f} ms)\n", saved.step,
+                                              saved.ok ? "written" : "FAILED", saved.seconds * 1e3);
+            std::cout.write(line, out.out - line);
+        }
+
+        // The renderer gets the mesh field as a slice
+        if (solver == Solver::ParticleMesh)
+        {
+            AllocScope scope("potential slice");
+            if (!pm.solved)
+                solveMesh(pm, objects);
+            if (potential.version != pm.version)
+            {
+                potential.sample(pool, pm, POTENTIAL_MAP_SIZE);
+                changed = true;
+            }
+        }
+    }
+
+    // Copy into the back slot; vectors keep their capacity, so steady state does not allocate
+    void publish()
+    {
+        AllocScope scope("publish");
+        SimState& s = states.back();
+        s.bodies = objects;
+        objects.endFrame();
+        if (s.tracerVersion != tracerVersion)
+        {
+            s.x.assign(tracers.x.begin(), tracers.x.end());
+            s.y.assign(tracers.y.begin(), tracers.y.end());
+            s.z.assign(tracers.z.begin(), tracers.z.end());
+            s.tracerVersion = tracerVersion;
+        }
+        if (solver == Solver::ParticleMesh && s.potential.version != potential.version)
+            s.potential = potential;
+        s.solver = solver;
+        s.gravity = gravity;
+        s.step = steps;
+        s.stepSeconds = stepSeconds;
+        states.publish();
+    }
+};
+
+// How grid.vert displaces the grid
+enum class GridWarp
+{
+    None = 0,          // vertices were warped on the CPU
+    Schwarzschild = 1, // clipmap, sum of each object's embedding from the Objects UBO
+    Potential = 2,     // clipmap, particle-mesh potential map
+};
+
+// GPU grid: nested clipmap levels around the camera target, each CLIPMAP_CELLS across and twice
+// as coarse as the one inside it. The finest spacing follows Camera::radius in octave steps.
+constexpr int CLIPMAP_LEVELS = 8;
+constexpr int CLIPMAP_CELLS = 64;
+constexpr float CLIPMAP_DETAIL = 1.0f / 256.0f; // finest spacing per meter of camera radius
+// CPU grid: 256 x 256 cells over 2.56e11 m
+constexpr int CPU_GRID_CELLS = 256;
+constexpr float CPU_GRID_SPACING = 1e9f;
+
+static_assert(CLIPMAP_LEVELS <= 16, "grid.vert holds 16 clipmap origins");
+
+// geodesic.comp's float outputs besides the color, four channels each: aovHit, aovEnd, aovDisk
+constexpr int AOV_TARGETS = 3;
+
+// Textures to trace the AOVs of a w x h block into, with one for its color
+struct AovTargets
+{
+    GLuint color = 0;
+    std::array<GLuint, AOV_TARGETS> aovs{};
+
+    void create(int width, int height)
+    {
+        glGenTextures(1, &color);
+        glBindTexture(GL_TEXTURE_2D, color);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glGenTextures(AOV_TARGETS, aovs.data());
+        for (GLuint texture : aovs)
+        {
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+        }
+    }
+
+    // Color then each AOV, as RGBA floats, into GL_PIXEL_PACK_BUFFER offsets or client memory
+    void read(int width, int height, std::byte* dst) const
+    {
+        const size_t bytes = size_t(width) * height * 4 * sizeof(float);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D, color);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, dst);
+        for (int i = 0; i < AOV_TARGETS; ++i)
+        {
+            glBindTexture(GL_TEXTURE_2D, aovs[i]);
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, dst + (i + 1) * bytes);
+        }
+    }
+
+    void destroy()
+    {
+        glDeleteTextures(1, &color);
+        glDeleteTextures(AOV_TARGETS, aovs.data());
+        color = 0;
+        aovs = {};
+    }
+};
+
+// A traced image's color and AOVs on the CPU, RGBA floats with rows bottom-up as GL reads them
+struct AovImage
+{
+    int width = 0, height = 0;
+    std::vector<float> data; // color, then each AOV target, width * height * 4 floats each
+
+    void resize(int w, int h)
+    {
+        width = w;
+        height = h;
+        data.assign(planeFloats() * (1 + AOV_TARGETS), 0.0f);
+    }
+
+    size_t planeFloats() const
+    {
+        return size_t(width) * height * 4;
+    }
+
+    // Multi-layer EXR: color as R, G, B, A (premultiplied, as EXR expects), and the AOVs as
+    // hit.*, end.* and disk.* layers
+    void encodeExr(std::vector<std::byte>& out) const
+    {
+        std::vector<float> color(data.begin(), data.begin() + planeFloats());
+        for (size_t i = 0; i < color.size(); i += 4)
+            for (int c = 0; c < 3; ++c)
+                color[i + c] *= color[i + 3];
+
+        struct Name
+        {
+            const char* name;
+            int plane, channel;
+        };
+        static constexpr Name NAMES[] = {
+            {"R", 0, 0}, {"G", 0, 1}, {"B", 0, 2}, {"A", 0, 3},
+            {"hit.class", 1, 0}, {"hit.object", 1, 1}, {"hit.steps", 1, 2}, {"hit.lambda", 1, 3},
+            {"end.X", 2, 0}, {"end.Y", 2, 1}, {"end.Z", 2, 2},
+            {"disk.radius", 3, 0}, {"disk.phi", 3, 1},
+        };
+        std::vector<ExrChannel> channels;
+        const ptrdiff_t row = ptrdiff_t(width) * 4;
+        for (const Name& n : NAMES)
+        {
+            const float* plane = n.plane == 0 ? color.data() : data.data() + n.plane * planeFloats();
+            channels.push_back({n.name, plane + (height - 1) * row + n.channel, 4, -row});
+        }
+        ::encodeExr(width, height, channels, out);
+    }
+};
+
 struct Engine
 {
     struct QuadData
@@ -189,60 +993,106 @@ struct Engine
     };
 
     GLuint gridShaderProgram;
+    GLuint tracerShaderProgram;
     // -- Quad & Texture render -- //
-    GLFWwindow* window;
+    GLFWwindow* window = nullptr;  // none when headless
+    void* eglDisplay = nullptr;     // headless only
+    void* eglContext = nullptr;
     GLuint quadVAO;
     GLuint texture;
     GLuint shaderProgram;
     GLuint computeProgram = 0;
+    GLint tileLocation = -1; // geodesic.comp `tile`
+    GLint writeAovsLocation = -1;
+    GLint layersLocation = -1; // geodesic.comp `layers`, and `layerTurn`
+    GLint layerTurnLocation = -1;
     // -- UBOs -- //
     GLuint cameraUBO = 0;
     GLuint diskUBO = 0;
     GLuint objectsUBO = 0;
+    uint64_t objectsSynced = 0; // BodyRegistry pull of the objects UBO
     // -- grid mess vars -- //
     GLuint gridVAO = 0;
     GLuint gridVBO = 0;
     GLuint gridEBO = 0;
     int gridIndexCount = 0;
+    CpuGrid cpuGrid{CPU_GRID_CELLS, CPU_GRID_SPACING};
+    static constexpr int GRID_REGIONS = 3;
+    float* gridMapped = nullptr; // persistent mapping, null without ARB_buffer_storage
+    GLsync gridFences[GRID_REGIONS] = {};
+    int gridRegion = 0; // region drawn by drawGrid
+    bool gridFromField = false;
+    uint64_t gridSynced = 0; // BodyRegistry pull of the Schwarzschild warp
+    unsigned gridFieldVersion = 0;
+    double gridSeconds = 0.0; // cost of the last CPU grid update
+    // -- static clipmap grid, placed and warped in grid.vert -- //
+    GLuint clipmapVAO = 0;
+    GLuint clipmapVBO = 0;
+    GLuint clipmapEBO = 0;
+    int clipmapIndexCount = 0;
+    GLuint potentialTexture = 0;
+    unsigned potentialVersion = 0;
+    float potentialOrigin = 0.0f; // xz corner of the potential map in meters
+    float potentialExtent = 0.0f; // xz edge of the potential map in meters
+    // -- tracer points -- //
+    GLuint tracerVAO = 0;
+    GLuint tracerVBO = 0;
+    size_t tracerCapacity = 0;
 
     int WIDTH = 800;               // Window width
     int HEIGHT = 600;              // Window height
     int COMPUTE_WIDTH = 200;       // Compute resolution width
     int COMPUTE_HEIGHT = 150;      // Compute resolution height
+    int traceWidth = 0, traceHeight = 0; // allocated size of the traced image
     float width = 100000000000.0f; // Width of the viewport in meters
     float height = 75000000000.0f; // Height of the viewport in meters
 
-    Engine()
+    // Headless: a GL context without a window, for drawing into framebuffers only
+    explicit Engine(bool headless = false)
     {
-        if (!glfwInit())
+        if (headless)
         {
-            std::cerr << "GLFW init failed\n";
-            exit(EXIT_FAILURE);
+            createHeadlessContext();
         }
-        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-        window = glfwCreateWindow(WIDTH, HEIGHT, "Black Hole", nullptr, nullptr);
-        if (!window)
+        else
         {
-            std::cerr << "Failed to create GLFW window\n";
-            glfwTerminate();
-            exit(EXIT_FAILURE);
+            if (!glfwInit())
+            {
+                std::cerr << "GLFW init failed\n";
+                exit(EXIT_FAILURE);
+            }
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+            glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+            window = glfwCreateWindow(WIDTH, HEIGHT, "Black Hole", nullptr, nullptr);
+            if (!window)
+            {
+                std::cerr << "Failed to create GLFW window\n";
+                glfwTerminate();
+                exit(EXIT_FAILURE);
+            }
+            glfwMakeContextCurrent(window);
         }
-        glfwMakeContextCurrent(window);
         glewExperimental = GL_TRUE;
-        GLenum glewErr = glewInit();
+        // Without a window there is no GLX display to initialize, only the context's entry points
+        GLenum glewErr = headless ? glewContextInit() : glewInit();
         if (glewErr != GLEW_OK)
         {
             std::cerr << "Failed to initialize GLEW: " << (const char*)glewGetErrorString(glewErr) << "\n";
-            glfwTerminate();
+            if (!headless)
+                glfwTerminate();
             exit(EXIT_FAILURE);
         }
         std::cout << "OpenGL " << glGetString(GL_VERSION) << "\n";
         std::cout << "Using GPU: " << glGetString(GL_RENDERER) << "\n";
         shaderProgram = CreateShaderProgram();
         gridShaderProgram = CreateShaderProgram("grid.vert", "grid.frag");
+        tracerShaderProgram = CreateShaderProgram("tracer.vert", "tracer.frag");
         computeProgram = CreateComputeProgram("geodesic.comp");
+        tileLocation = glGetUniformLocation(computeProgram, "tile");
+        writeAovsLocation = glGetUniformLocation(computeProgram, "writeAovs");
+        layersLocation = glGetUniformLocation(computeProgram, "layers");
+        layerTurnLocation = glGetUniformLocation(computeProgram, "layerTurn");
         glGenBuffers(1, &cameraUBO);
         glBindBuffer(GL_UNIFORM_BUFFER, cameraUBO);
         glBufferData(GL_UNIFORM_BUFFER, 128, nullptr, GL_DYNAMIC_DRAW); // alloc ~128 bytes
@@ -256,83 +1106,289 @@ struct Engine
         glGenBuffers(1, &objectsUBO);
         glBindBuffer(GL_UNIFORM_BUFFER, objectsUBO);
         // allocate space for 16 objects:
-        // sizeof(int) + padding + 16×(vec4 posRadius + vec4 color)
-        GLsizeiptr objUBOSize = sizeof(int) + 3 * sizeof(float) + 16 * (sizeof(vec4) + sizeof(vec4)) + 16 * sizeof(float); // 16 floats for mass
+        // sizeof(int) + padding + 16×(vec4 posRadius + vec4 color + vec4-strided mass)
+        GLsizeiptr objUBOSize = sizeof(int) + 3 * sizeof(float) + 16 * (sizeof(vec4) + sizeof(vec4) + sizeof(vec4));
         glBufferData(GL_UNIFORM_BUFFER, objUBOSize, nullptr, GL_DYNAMIC_DRAW);
         glBindBufferBase(GL_UNIFORM_BUFFER, 3, objectsUBO); // binding = 3 matches shader
 
         auto [vao, tex] = QuadVAO();
         quadVAO = vao;
         texture = tex;
+
+        createClipmap();
     }
 
-    void generateGrid(const std::vector<ObjectData>& objects)
+    // GL 4.3 core through EGL with no surface at all, so it runs without a display server: Mesa's
+    // surfaceless platform (llvmpipe included) when available, else the default display
+    void createHeadlessContext()
     {
-        constexpr int gridSize = 25;
-        constexpr float spacing = 1e10f;
-
-        std::vector<vec3> vertices;
-        std::vector<GLuint> indices;
-
-        for (int z = 0; z <= gridSize; ++z)
+#ifdef __linux__
+        auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+        EGLDisplay display = getPlatformDisplay ? getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr) : EGL_NO_DISPLAY;
+        if (display == EGL_NO_DISPLAY)
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        EGLint major = 0, minor = 0;
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor) || !eglBindAPI(EGL_OPENGL_API))
         {
-            for (int x = 0; x <= gridSize; ++x)
-            {
-                const float worldX = (x - gridSize / 2) * spacing;
-                const float worldZ = (z - gridSize / 2) * spacing;
-
-                float y = 0.0f;
-
-                // Warp grid using Schwarzschild geometry
-                for (const auto& obj : objects)
-                {
-                    const vec3 objPos = vec3(obj.posRadius);
-                    const double r_s = 2.0 * G * obj.mass / (C * C);
-                    const double dx = worldX - objPos.x;
-                    const double dz = worldZ - objPos.z;
-                    const double dist = std::sqrt(dx * dx + dz * dz);
+            std::cerr << "Failed to initialize EGL\n";
+            exit(EXIT_FAILURE);
+        }
 
-                    if (dist > r_s)
+        // Any config will do since nothing is drawn to an EGL surface; none at all with EGL_KHR_no_config_context
+        const EGLint configAttribs[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+        EGLConfig config = EGL_NO_CONFIG_KHR;
+        EGLint configs = 0;
+        eglChooseConfig(display, configAttribs, &config, 1, &configs);
+        const EGLint contextAttribs[] = {EGL_CONTEXT_MAJOR_VERSION, 4, EGL_CONTEXT_MINOR_VERSION, 3,
+                                         EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE};
+        EGLContext context = eglCreateContext(display, configs ? config : EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttribs);
+        if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+        {
+            std::cerr << "Failed to create a headless OpenGL 4.3 context (EGL " << major << '.' << minor << ")\n";
+            eglTerminate(display);
+            exit(EXIT_FAILURE);
+        }
+        eglDisplay = display;
+        eglContext = context;
+#else
+        std::cerr << "Headless rendering needs EGL, available on Linux only\n";
+        exit(EXIT_FAILURE);
+#endif
+    }
+
+    void destroyHeadlessContext()
+    {
+#ifdef __linux__
+        if (!eglDisplay)
+            return;
+        eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(eglDisplay, eglContext);
+        eglTerminate(eglDisplay);
+        eglDisplay = eglContext = nullptr;
+#endif
+    }
+
+    // Line-list indices of a (cells + 1)^2 vertex lattice
+    static std::vector<GLuint> gridLineIndices(int cells)
+    {
+        std::vector<GLuint> indices;
+        indices.reserve(size_t(cells) * cells * 4);
+        for (int z = 0; z < cells; ++z)
+        {
+            for (int x = 0; x < cells; ++x)
+            {
+                const int i = z * (cells + 1) + x;
+                indices.push_back(i);
+                indices.push_back(i + 1);
+                indices.push_back(i);
+                indices.push_back(i + cells + 1);
+            }
+        }
+        return indices;
+    }
+
+    // Upload the clipmap once as level-local (i, j, level) lattice coordinates. Level 0 is a full
+    // block; every other level is a ring whose hole is covered by the level inside it.
+    void createClipmap()
+    {
+        constexpr int n = CLIPMAP_CELLS, side = CLIPMAP_CELLS + 1;
+        constexpr int holeLo = n / 4, holeHi = 3 * n / 4;
+        std::vector<vec3> vertices;
+        std::vector<GLuint> indices;
+        vertices.reserve(size_t(CLIPMAP_LEVELS) * side * side);
+
+        for (int level = 0; level < CLIPMAP_LEVELS; ++level)
+        {
+            const auto base = static_cast<GLuint>(vertices.size());
+            for (int j = 0; j <= n; ++j)
+                for (int i = 0; i <= n; ++i)
+                    vertices.emplace_back(float(i), float(j), float(level));
+
+            // A segment is dropped if it lies inside the hole; segments on the hole's rim stay
+            auto inHole = [&](int i0, int j0, int i1, int j1)
+            {
+                return level > 0 && std::min(i0, i1) >= holeLo && std::max(i0, i1) <= holeHi && std::min(j0, j1) >= holeLo &&
+                       std::max(j0, j1) <= holeHi && !(i0 == i1 && (i0 == holeLo || i0 == holeHi)) &&
+                       !(j0 == j1 && (j0 == holeLo || j0 == holeHi));
+            };
+            for (int j = 0; j <= n; ++j)
+            {
+                for (int i = 0; i <= n; ++i)
+                {
+                    const GLuint v = base + j * side + i;
+                    if (i < n && !inHole(i, j, i + 1, j))
                     {
-                        const double deltaY = 2.0 * std::sqrt(r_s * (dist - r_s));
-                        y += static_cast<float>(deltaY) - 3e10f;
+                        indices.push_back(v);
+                        indices.push_back(v + 1);
                     }
-                    else
+                    if (j < n && !inHole(i, j, i, j + 1))
                     {
-                        y += 2.0f * static_cast<float>(std::sqrt(r_s * r_s)) - 3e10f;
+                        indices.push_back(v);
+                        indices.push_back(v + side);
                     }
                 }
-
-                vertices.emplace_back(worldX, y, worldZ);
             }
         }
 
-        // Add indices for GL_LINE rendering
-        for (int z = 0; z < gridSize; ++z)
+        glGenVertexArrays(1, &clipmapVAO);
+        glGenBuffers(1, &clipmapVBO);
+        glGenBuffers(1, &clipmapEBO);
+
+        glBindVertexArray(clipmapVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, clipmapVBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vec3), vertices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, clipmapEBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0); // location = 0
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3), (void*)0);
+        glBindVertexArray(0);
+
+        clipmapIndexCount = static_cast<int>(indices.size());
+    }
+
+    // Level placement for the current camera, read by grid.vert
+    void uploadClipmapUniforms(const Camera& cam)
+    {
+        // Finest spacing is a power of two; the fractional octave morphs level 0 into level 1 and
+        // fades the outermost level in, so crossing an octave is seamless
+        const float octave = std::log2(std::max(cam.radius * CLIPMAP_DETAIL, 1.0f));
+        const float baseSpacing = std::exp2(std::floor(octave));
+
+        vec2 origins[CLIPMAP_LEVELS];
+        for (int level = 0; level < CLIPMAP_LEVELS; ++level)
+        {
+            // Snap to twice the level spacing so even vertices coincide with the next level's
+            const float snap = 2.0f * baseSpacing * float(1 << level);
+            origins[level] = vec2(std::round(cam.target.x / snap) * snap, std::round(cam.target.z / snap) * snap);
+        }
+
+        glUniform1i(glGetUniformLocation(gridShaderProgram, "clipLevels"), CLIPMAP_LEVELS);
+        glUniform1f(glGetUniformLocation(gridShaderProgram, "clipCells"), float(CLIPMAP_CELLS));
+        glUniform1f(glGetUniformLocation(gridShaderProgram, "clipSpacing"), baseSpacing);
+        glUniform1f(glGetUniformLocation(gridShaderProgram, "clipMorph"), octave - std::floor(octave));
+        glUniform2fv(glGetUniformLocation(gridShaderProgram, "clipOrigin"), CLIPMAP_LEVELS, &origins[0].x);
+    }
+
+    // Upload the 2 * phi / c^2 slice of the mesh solution as a float texture for grid.vert
+    void uploadPotentialMap(const PotentialSlice& field)
+    {
+        if (field.version == 0 || (potentialTexture != 0 && potentialVersion == field.version))
+            return;
+
+        // The map spans the mesh cube's y = 0 slice; texel centres sit on its edges
+        potentialOrigin = field.origin;
+        potentialExtent = field.extent;
+
+        if (potentialTexture == 0)
+        {
+            glGenTextures(1, &potentialTexture);
+            glBindTexture(GL_TEXTURE_2D, potentialTexture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, POTENTIAL_MAP_SIZE, POTENTIAL_MAP_SIZE, 0, GL_RED, GL_FLOAT, nullptr);
+        }
+        glBindTexture(GL_TEXTURE_2D, potentialTexture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, POTENTIAL_MAP_SIZE, POTENTIAL_MAP_SIZE, GL_RED, GL_FLOAT, field.values.data());
+        potentialVersion = field.version;
+    }
+
+    // CPU grid: warped by the Schwarzschild embedding of each object, updated incrementally by
+    // CpuGrid, or by the potential slice `field` if given. Vertices are written straight into the
+    // vertex buffer, and only when one changed.
+    void generateGrid(const BodyRegistry& objects, const PotentialSlice* field = nullptr)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        const bool fresh = gridVAO == 0;
+        if (fresh)
+        {
+            AllocScope scope("grid buffers", true); // once, the first time the grid goes to the CPU
+            createGridBuffers();
+        }
+
+        if (field)
         {
-            for (int x = 0; x < gridSize; ++x)
+            // Warp grid using the mesh potential, shared with the gravity solver
+            if (fresh || !gridFromField || field->version != gridFieldVersion)
             {
-                const int i = z * (gridSize + 1) + x;
-                indices.push_back(i);
-                indices.push_back(i + 1);
-                indices.push_back(i);
-                indices.push_back(i + gridSize + 1);
+                float* dst = beginGridWrite();
+                const int side = cpuGrid.side();
+                pool.parallelFor(side, [&](size_t begin, size_t end)
+                                 {
+                                     for (size_t z = begin; z < end; ++z)
+                                     {
+                                         for (int x = 0; x < side; ++x)
+                                         {
+                                             const float worldX = cpuGrid.coord(x), worldZ = cpuGrid.coord(int(z));
+                                             float* v = dst + 3 * (z * side + x);
+                                             v[0] = worldX;
+                                             v[1] = static_cast<float>(POTENTIAL_DEPTH * field->at(worldX, worldZ));
+                                             v[2] = worldZ;
+                                         }
+                                     } });
+                endGridWrite();
+            }
+            gridFieldVersion = field->version;
+            gridFromField = true;
+        }
+        else
+        {
+            // Warp grid using Schwarzschild geometry, only where bodies moved
+            cpuGrid.changed = false;
+            const bool resized = fresh || objects.resized(gridSynced);
+            if (resized || objects.changed(BODY_POSITION | BODY_MASS, gridSynced))
+            {
+                AllocScope scope("grid caches", resized); // sized for a new set of bodies
+                std::pmr::vector<CpuGrid::Body> bodies(&frameArena);
+                bodies.reserve(objects.size());
+                for (size_t i = 0; i < objects.size(); ++i)
+                    bodies.push_back({objects.x[i], objects.z[i], static_cast<float>(2.0 * G * objects.mass[i] / (C * C))});
+                cpuGrid.update(pool, bodies);
             }
+            gridSynced = objects.synced();
+
+            if (fresh || cpuGrid.changed || gridFromField)
+            {
+                cpuGrid.writeVertices(pool, beginGridWrite());
+                endGridWrite();
+            }
+            gridFromField = false;
         }
 
-        // Upload to GPU
-        if (gridVAO == 0)
-            glGenVertexArrays(1, &gridVAO);
-        if (gridVBO == 0)
-            glGenBuffers(1, &gridVBO);
-        if (gridEBO == 0)
-            glGenBuffers(1, &gridEBO);
+        gridSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    size_t gridVertexCount() const
+    {
+        return size_t(cpuGrid.side()) * cpuGrid.side();
+    }
+
+    // With ARB_buffer_storage the vertex buffer holds GRID_REGIONS copies of the grid, persistently
+    // mapped and cycled under fences; otherwise each write maps and invalidates a single copy
+    void createGridBuffers()
+    {
+        glGenVertexArrays(1, &gridVAO);
+        glGenBuffers(1, &gridVBO);
+        glGenBuffers(1, &gridEBO);
 
         glBindVertexArray(gridVAO);
 
+        const GLsizeiptr bytes = gridVertexCount() * sizeof(vec3);
         glBindBuffer(GL_ARRAY_BUFFER, gridVBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vec3), vertices.data(), GL_DYNAMIC_DRAW);
+        if (GLEW_ARB_buffer_storage)
+        {
+            constexpr GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_ARRAY_BUFFER, GRID_REGIONS * bytes, nullptr, flags);
+            gridMapped = static_cast<float*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, GRID_REGIONS * bytes, flags));
+        }
+        else
+        {
+            glBufferData(GL_ARRAY_BUFFER, bytes, nullptr, GL_DYNAMIC_DRAW);
+        }
 
+        // Indices for GL_LINE rendering never change, upload them once
+        const std::vector<GLuint> indices = gridLineIndices(cpuGrid.cells);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gridEBO);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
 
@@ -344,17 +1400,127 @@ struct Engine
         glBindVertexArray(0);
     }
 
-    void drawGrid(const mat4& viewProj)
+    // Where the next grid vertices go; endGridWrite() makes them the ones drawn
+    float* beginGridWrite()
+    {
+        if (gridMapped)
+        {
+            const int region = (gridRegion + 1) % GRID_REGIONS;
+            if (GLsync fence = gridFences[region])
+            {
+                while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1'000'000) == GL_TIMEOUT_EXPIRED)
+                {
+                }
+                glDeleteSync(fence);
+                gridFences[region] = nullptr;
+            }
+            return gridMapped + region * gridVertexCount() * 3;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, gridVBO);
+        return static_cast<float*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, gridVertexCount() * sizeof(vec3),
+                                                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+    }
+
+    void endGridWrite()
+    {
+        if (gridMapped)
+        {
+            gridRegion = (gridRegion + 1) % GRID_REGIONS;
+            return;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, gridVBO);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+
+    void drawGrid(const mat4& viewProj, GridWarp warp, const Camera& cam)
     {
         glUseProgram(gridShaderProgram);
         glUniformMatrix4fv(glGetUniformLocation(gridShaderProgram, "viewProj"), 1, GL_FALSE, glm::value_ptr(viewProj));
-        glBindVertexArray(gridVAO);
+        glUniform1i(glGetUniformLocation(gridShaderProgram, "warpMode"), static_cast<int>(warp));
+        const bool clipmap = warp != GridWarp::None;
+        if (clipmap)
+            uploadClipmapUniforms(cam);
+        if (warp == GridWarp::Potential)
+        {
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, potentialTexture);
+            glUniform1i(glGetUniformLocation(gridShaderProgram, "potentialMap"), 1);
+            glUniform4f(glGetUniformLocation(gridShaderProgram, "potentialRect"),
+                        potentialOrigin, potentialOrigin, potentialExtent, potentialExtent);
+            glUniform1f(glGetUniformLocation(gridShaderProgram, "potentialDepth"), static_cast<float>(POTENTIAL_DEPTH));
+            glActiveTexture(GL_TEXTURE0);
+        }
+        glBindVertexArray(clipmap ? clipmapVAO : gridVAO);
 
         glDisable(GL_DEPTH_TEST);
         glEnable(GL_BLEND);
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-        glDrawElements(GL_LINES, gridIndexCount, GL_UNSIGNED_INT, 0);
+        if (clipmap)
+        {
+            glDrawElements(GL_LINES, clipmapIndexCount, GL_UNSIGNED_INT, 0);
+        }
+        else
+        {
+            const auto baseVertex = static_cast<GLint>(gridMapped ? gridRegion * gridVertexCount() : 0);
+            glDrawElementsBaseVertex(GL_LINES, gridIndexCount, GL_UNSIGNED_INT, 0, baseVertex);
+            if (gridMapped)
+            {
+                // The region may not be rewritten until this draw has consumed it
+                if (gridFences[gridRegion])
+                    glDeleteSync(gridFences[gridRegion]);
+                gridFences[gridRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            }
+        }
+
+        glBindVertexArray(0);
+        glEnable(GL_DEPTH_TEST);
+    }
+
+    void uploadTracers(std::span<const float> x, std::span<const float> y, std::span<const float> z)
+    {
+        if (tracerVAO == 0)
+            glGenVertexArrays(1, &tracerVAO);
+        if (tracerVBO == 0)
+            glGenBuffers(1, &tracerVBO);
+
+        // Columns are uploaded as-is: [x...][y...][z...], one float attribute each
+        const size_t n = x.size();
+        const GLsizeiptr column = n * sizeof(float);
+
+        glBindVertexArray(tracerVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, tracerVBO);
+        if (n != tracerCapacity)
+        {
+            glBufferData(GL_ARRAY_BUFFER, 3 * column, nullptr, GL_DYNAMIC_DRAW);
+            for (GLuint i = 0; i < 3; ++i)
+            {
+                glEnableVertexAttribArray(i); // location = 0, 1, 2
+                glVertexAttribPointer(i, 1, GL_FLOAT, GL_FALSE, sizeof(float), reinterpret_cast<void*>(i * column));
+            }
+            tracerCapacity = n;
+        }
+        glBufferSubData(GL_ARRAY_BUFFER, 0 * column, column, x.data());
+        glBufferSubData(GL_ARRAY_BUFFER, 1 * column, column, y.data());
+        glBufferSubData(GL_ARRAY_BUFFER, 2 * column, column, z.data());
+
+        glBindVertexArray(0);
+    }
+
+    void drawTracers(const mat4& viewProj)
+    {
+        if (tracerCapacity == 0)
+            return;
+
+        glUseProgram(tracerShaderProgram);
+        glUniformMatrix4fv(glGetUniformLocation(tracerShaderProgram, "viewProj"), 1, GL_FALSE, glm::value_ptr(viewProj));
+        glBindVertexArray(tracerVAO);
+
+        glDisable(GL_DEPTH_TEST);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+        glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(tracerCapacity));
 
         glBindVertexArray(0);
         glEnable(GL_DEPTH_TEST);
@@ -537,28 +1703,66 @@ struct Engine
 
         // 1) reallocate the texture if needed
         glBindTexture(GL_TEXTURE_2D, texture);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, cw, ch, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        if (cw != traceWidth || ch != traceHeight)
+        {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, cw, ch, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            traceWidth = cw;
+            traceHeight = ch;
+        }
+
+        // 2) trace the whole image
+        traceRegion(cam, float(WIDTH) / float(HEIGHT), texture, 0, 0, cw, ch, cw, ch);
+    }
 
-        // 2) bind compute program & UBOs
+    // Traces the w x h block at (x, y) of a fullWidth x fullHeight image into `target`, whose
+    // texel (0, 0) is the block's corner, and into the RGBA32F `aovs` (AovTargets) if given. The
+    // disk UBO is uploaded by its owner: the frame graph's "disk" stage, or a headless setup.
+    void traceRegion(const Camera& cam, float aspect, GLuint target, int x, int y, int w, int h, int fullWidth, int fullHeight,
+                     const GLuint* aovs = nullptr)
+    {
+        // 1) bind compute program & camera
         glUseProgram(computeProgram);
-        uploadCameraUBO(cam);
-        uploadDiskUBO();
-        uploadObjectsUBO(objects);
+        uploadCameraUBO(cam, aspect);
+        glUniform4i(tileLocation, x, y, fullWidth, fullHeight);
+        glUniform1i(writeAovsLocation, aovs != nullptr);
+        glUniform1i(layersLocation, 0);
 
-        // 3) bind it as image unit 0
-        glBindImageTexture(0, texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+        // 2) bind it as image unit 0, the AOVs after it
+        glBindImageTexture(0, target, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+        for (int i = 0; aovs && i < AOV_TARGETS; ++i)
+            glBindImageTexture(1 + i, aovs[i], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
 
-        // 4) dispatch grid
+        // 3) dispatch grid
         constexpr float workGroupSize = 16.0f;
-        const auto groupsX = static_cast<GLuint>(std::ceil(cw / workGroupSize));
-        const auto groupsY = static_cast<GLuint>(std::ceil(ch / workGroupSize));
+        const auto groupsX = static_cast<GLuint>(std::ceil(w / workGroupSize));
+        const auto groupsY = static_cast<GLuint>(std::ceil(h / workGroupSize));
         glDispatchCompute(groupsX, groupsY, 1);
 
-        // 5) sync
-        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        // 4) sync, for sampling and for reading back
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+    }
+
+    static constexpr int MAX_LAYERS = 8; // geodesic.comp `layerTurn`
+
+    // Traces w x h views into the first turns.size() layers of the GL_TEXTURE_2D_ARRAY `target` in
+    // one dispatch. Layer i is `cam` turned by turns[i] radians of azimuth, which is exactly the
+    // view from the same radius and elevation at that azimuth, since the camera orbits the y axis.
+    void traceLayers(const Camera& cam, float aspect, GLuint target, int w, int h, std::span<const float> turns)
+    {
+        glUseProgram(computeProgram);
+        uploadCameraUBO(cam, aspect);
+        glUniform4i(tileLocation, 0, 0, w, h);
+        glUniform1i(writeAovsLocation, 0);
+        glUniform1i(layersLocation, int(turns.size()));
+        glUniform1fv(layerTurnLocation, GLsizei(turns.size()), turns.data());
+        glBindImageTexture(4, target, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA8);
+
+        constexpr float workGroupSize = 16.0f;
+        glDispatchCompute(static_cast<GLuint>(std::ceil(w / workGroupSize)), static_cast<GLuint>(std::ceil(h / workGroupSize)), GLuint(turns.size()));
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
     }
 
-    void uploadCameraUBO(const Camera& cam)
+    void uploadCameraUBO(const Camera& cam, float aspect)
     {
         struct UBOData
         {
@@ -586,14 +1790,15 @@ struct Engine
         data.up = up;
         data.forward = fwd;
         data.tanHalfFov = std::tan(glm::radians(60.0f * 0.5f));
-        data.aspect = float(WIDTH) / float(HEIGHT);
+        data.aspect = aspect;
         data.moving = cam.dragging || cam.panning;
 
         glBindBuffer(GL_UNIFORM_BUFFER, cameraUBO);
         glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(UBOData), &data);
     }
 
-    void uploadObjectsUBO(const std::vector<ObjectData>& objs)
+    // Uploads only the UBO ranges of fields that changed since the last upload
+    void uploadObjectsUBO(const BodyRegistry& objs)
     {
         struct UBOData
         {
@@ -601,21 +1806,50 @@ struct Engine
             float _pad0, _pad1, _pad2;
             vec4 posRadius[16];
             vec4 color[16];
-            float mass[16];
-        } data;
+            vec4 mass[16]; // x = mass, std140 pads scalar array elements to 16 bytes
+        };
 
         const auto count = std::min(objs.size(), size_t{16});
-        data.numObjects = static_cast<int>(count);
-
-        for (size_t i = 0; i < count; ++i)
+        glBindBuffer(GL_UNIFORM_BUFFER, objectsUBO);
+        if (objs.resized(objectsSynced))
         {
-            data.posRadius[i] = objs[i].posRadius;
-            data.color[i] = objs[i].color;
-            data.mass[i] = objs[i].mass;
+            const int numObjects = static_cast<int>(count);
+            glBufferSubData(GL_UNIFORM_BUFFER, offsetof(UBOData, numObjects), sizeof(numObjects), &numObjects);
         }
 
-        glBindBuffer(GL_UNIFORM_BUFFER, objectsUBO);
-        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(data), &data);
+        auto upload = [&](unsigned fields, size_t offset, auto&& value)
+        {
+            objs.forEachChanged(fields, objectsSynced, [&](size_t begin, size_t end)
+                                {
+                                    end = std::min(end, count);
+                                    if (begin >= end)
+                                        return;
+                                    vec4 values[16];
+                                    for (size_t i = begin; i < end; ++i)
+                                        values[i - begin] = value(i);
+                                    glBufferSubData(GL_UNIFORM_BUFFER, offset + begin * sizeof(vec4), (end - begin) * sizeof(vec4), values); });
+        };
+        upload(BODY_POSITION | BODY_RADIUS, offsetof(UBOData, posRadius), [&](size_t i)
+               { return vec4(objs.x[i], objs.y[i], objs.z[i], objs.radius[i]); });
+        upload(BODY_COLOR, offsetof(UBOData, color), [&](size_t i)
+               { return vec4(objs.color[i].r, objs.color[i].g, objs.color[i].b, objs.color[i].a); });
+        upload(BODY_MASS, offsetof(UBOData, mass), [&](size_t i)
+               { return vec4(objs.mass[i], 0.0f, 0.0f, 0.0f); });
+        objectsSynced = objs.synced();
+    }
+
+    // A copy of the objects UBO, to trace with while the bodies move on; bind it to binding 3
+    GLuint copyObjectsUBO() const
+    {
+        GLuint copy;
+        GLint size = 0;
+        glBindBuffer(GL_COPY_READ_BUFFER, objectsUBO);
+        glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &size);
+        glGenBuffers(1, &copy);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, copy);
+        glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STATIC_DRAW);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, size);
+        return copy;
     }
 
     void uploadDiskUBO()
@@ -682,102 +1916,2973 @@ struct Engine
     };
 };
 
-Engine engine;
-
-void setupCameraCallbacks(GLFWwindow* window)
+void setupInputCallbacks(GLFWwindow* window, InputRouting& routing)
 {
-    glfwSetWindowUserPointer(window, &camera);
+    glfwSetWindowUserPointer(window, &routing);
 
     glfwSetMouseButtonCallback(window, [](GLFWwindow* win, int button, int action, int mods)
-                               { auto *cam = static_cast<Camera *>(glfwGetWindowUserPointer(win));
-                                 cam->processMouseButton(button, action, mods, win); });
+                               { auto *route = static_cast<InputRouting *>(glfwGetWindowUserPointer(win));
+                                 double x, y;
+                                 glfwGetCursorPos(win, &x, &y);
+                                 route->push({InputEvent::Type::MouseButton, button, action, x, y, glfwGetTime()}); });
 
     glfwSetCursorPosCallback(window, [](GLFWwindow* win, double x, double y)
-                             { auto *cam = static_cast<Camera *>(glfwGetWindowUserPointer(win));
-                               cam->processMouseMove(x, y); });
+                             { auto *route = static_cast<InputRouting *>(glfwGetWindowUserPointer(win));
+                               route->push({InputEvent::Type::MouseMove, 0, 0, x, y, glfwGetTime()}); });
 
     glfwSetScrollCallback(window, [](GLFWwindow* win, double xoffset, double yoffset)
-                          { auto *cam = static_cast<Camera *>(glfwGetWindowUserPointer(win));
-                            cam->processScroll(xoffset, yoffset); });
+                          { auto *route = static_cast<InputRouting *>(glfwGetWindowUserPointer(win));
+                            route->push({InputEvent::Type::Scroll, 0, 0, xoffset, yoffset, glfwGetTime()}); });
 
     glfwSetKeyCallback(window, [](GLFWwindow* win, int key, int scancode, int action, int mods)
-                       { auto *cam = static_cast<Camera *>(glfwGetWindowUserPointer(win));
-                         cam->processKey(key, scancode, action, mods); });
+                       { auto *route = static_cast<InputRouting *>(glfwGetWindowUserPointer(win));
+                         route->push({InputEvent::Type::Key, key, action, 0.0, 0.0, glfwGetTime()}); });
 }
 
-int main()
+// How the render loop is paced
+enum class Pacing
 {
-    setupCameraCallbacks(engine.window);
+    VSync,     // swap interval 1
+    Target,    // swap interval 0, frames started at a fixed rate
+    Eco,       // swap interval 1, and while nothing changes, asleep in glfwWaitEvents
+    Unlimited, // swap interval 0, as fast as it goes
+};
 
-    double lastTime = glfwGetTime();
-    double lastPrintTime = lastTime;
-    int framesCount = 0;
+constexpr std::array<const char*, 4> PACING_NAMES = {"vsync", "target", "eco", "unlimited"};
 
-    while (!glfwWindowShouldClose(engine.window))
+// Render-side switches, flipped by keys
+struct RenderOptions
+{
+    Pacing pacing = Pacing::VSync;
+    bool gridOnGpu = true;   // false: warp the grid on the CPU in generateGrid
+    bool screenshot = false; // save the next frame
+    bool record = false;     // start or stop recording video
+    bool poster = false;     // start, or resume, a poster
+    bool aovs = false;       // save the view's AOVs
+    bool printLatency = false;
+};
+
+// The renderer's share of the input: the camera, where the grid is warped, screenshots
+void handleRenderInput(const InputEvent& e, Camera& camera, RenderOptions& options)
+{
+    switch (e.type)
     {
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    case InputEvent::Type::MouseButton:
+        camera.processMouseButton(e.code, e.action, e.x, e.y);
+        break;
+    case InputEvent::Type::MouseMove:
+        camera.processMouseMove(e.x, e.y);
+        break;
+    case InputEvent::Type::Scroll:
+        camera.processScroll(e.x, e.y);
+        break;
+    case InputEvent::Type::Key:
+        if (e.action == GLFW_PRESS && e.code == GLFW_KEY_C)
+        {
+            options.gridOnGpu = !options.gridOnGpu;
+            std::cout << "\n[INFO] Grid warp on " << (options.gridOnGpu ? "GPU" : "CPU") << '\n';
+        }
+        if (e.action == GLFW_PRESS && e.code == GLFW_KEY_J)
+            printJobStats(pool);
+        if (e.action == GLFW_PRESS && e.code == GLFW_KEY_P)
+            options.screenshot = true;
+        if (e.action == GLFW_PRESS && e.code == GLFW_KEY_R)
+            options.record = true;
+        if (e.action == GLFW_PRESS && e.code == GLFW_KEY_O)
+            options.poster = true;
+        if (e.action == GLFW_PRESS && e.code == GLFW_KEY_X)
+            options.aovs = true;
+        if (e.action == GLFW_PRESS && e.code == GLFW_KEY_L)
+            options.printLatency = true;
+        if (e.action == GLFW_PRESS && e.code == GLFW_KEY_V)
+            options.pacing = static_cast<Pacing>((static_cast<int>(options.pacing) + 1) % PACING_NAMES.size());
+        break;
+    }
+}
 
-        double now = glfwGetTime();
-        lastTime = now;
+// What the raytrace depends on of the camera, without padding so it hashes as bytes
+struct CameraKey
+{
+    float radius, azimuth, elevation;
+    int moving;
 
-        // Update FPS and camera info
-        ++framesCount;
-        if (now - lastPrintTime >= 0.2)
+    bool operator==(const CameraKey&) const = default;
+};
+
+CameraKey cameraKey(const Camera& camera)
+{
+    return {camera.radius, camera.azimuth, camera.elevation, (camera.moving ? 1 : 0) | (camera.dragging || camera.panning ? 2 : 0)};
+}
+
+// Input-to-present latency of the events that moved the camera, in milliseconds
+struct LatencyStats
+{
+    static constexpr size_t CAPACITY = 4096;  // latest samples kept
+    static constexpr size_t PER_FRAME = 128;  // events timed per frame, the rest are dropped
+
+    std::array<float, CAPACITY> samples{};
+    size_t count = 0;
+    std::array<double, PER_FRAME> applied{}; // input times of the events applied this frame
+    size_t appliedCount = 0;
+
+    void apply(double inputTime)
+    {
+        if (appliedCount < PER_FRAME)
+            applied[appliedCount++] = inputTime;
+    }
+
+    // Right after the swap that first shows this frame's events
+    void presented(double now)
+    {
+        for (size_t i = 0; i < appliedCount; ++i)
+            samples[count++ % CAPACITY] = static_cast<float>((now - applied[i]) * 1e3);
+        appliedCount = 0;
+    }
+
+    void print() const
+    {
+        const size_t n = std::min(count, CAPACITY);
+        if (n == 0)
         {
-            double fps = framesCount / (now - lastPrintTime);
-            std::cout << std::format("\rFPS: {:.1f} | Radius: {:.2e} | Azimuth: {:.2f} | Elevation: {:.2f}",
-                                     fps, camera.radius, camera.azimuth, camera.elevation);
-            framesCount = 0;
-            lastPrintTime = now;
+            std::cout << "\n[LATENCY] No camera input yet\n";
+            return;
         }
+        std::array<float, CAPACITY> sorted;
+        std::copy_n(samples.begin(), n, sorted.begin());
+        std::sort(sorted.begin(), sorted.begin() + n);
+        auto percentile = [&](double p) { return sorted[std::min(n - 1, size_t(p * n))]; };
+        std::cout << std::format("\n[LATENCY] Input to present over {} events: p50 {:.1f} ms, p90 {:.1f} ms, p99 {:.1f} ms, max {:.1f} ms\n",
+                                 n, percentile(0.5), percentile(0.9), percentile(0.99), sorted[n - 1]);
+    }
+};
 
-        // Gravity simulation
-        if (g_gravity)
-        {
-            for (auto& obj : objects)
-            {
-                vec3 totalAcc(0.0f);
-                for (const auto& obj2 : objects)
-                {
-                    if (&obj == &obj2)
-                        continue;
+// Applies the queued render input, timing each event that moved the camera
+void drainRenderInput(InputQueue& queue, Camera& camera, RenderOptions& options, LatencyStats& latency)
+{
+    InputEvent e;
+    while (queue.pop(e))
+    {
+        const CameraKey before = cameraKey(camera);
+        handleRenderInput(e, camera, options);
+        if (!(cameraKey(camera) == before))
+            latency.apply(e.time);
+    }
+}
 
-                    vec3 delta = vec3(obj2.posRadius) - vec3(obj.posRadius);
-                    float distance = glm::length(delta);
+// Paces the render loop and measures, per mode, how busy it keeps the CPU and the GPU.
+//
+// A frame runs from one `beginFrame` to the next. CPU busy is that time minus the time spent
+// waiting (the limiter, glfwWaitEvents, and a blocking swap); GPU busy is the frame's GL work
+// measured by TIME_ELAPSED queries, read back a few frames late so they never stall.
+struct FramePacer
+{
+    // A Target frame sleeps until this close to its deadline and spins the rest; OS sleeps
+    // overshoot by up to about a millisecond
+    static constexpr double SPIN_SECONDS = 0.002;
+    static constexpr int GPU_QUERIES = 4;
 
-                    if (distance > 0.0f)
-                    {
-                        vec3 direction = delta / distance;
-                        double force = (G * obj.mass * obj2.mass) / (distance * distance);
-                        totalAcc += direction * float(force / obj.mass);
-                    }
-                }
+    struct Usage
+    {
+        double wall = 0.0;   // seconds of frames in this mode
+        double cpu = 0.0;    // busy seconds of those frames
+        double gpu = 0.0;    // GPU seconds of the frames whose query was read
+        uint64_t frames = 0;
+        uint64_t gpuFrames = 0;
+    };
+
+    Pacing mode = Pacing::VSync;
+    double targetFps = 60.0;
+    double deadline = 0.0;
+    std::array<Usage, PACING_NAMES.size()> usage{};
+
+    double frameStart = 0.0;
+    double waited = 0.0; // this frame
+
+    std::array<GLuint, GPU_QUERIES> queries{};
+    std::array<Pacing, GPU_QUERIES> queryMode{};
+    std::array<bool, GPU_QUERIES> queryPending{};
+    int query = 0;
+
+    void init(Pacing initial)
+    {
+        glGenQueries(GPU_QUERIES, queries.data());
+        setMode(initial);
+    }
 
-                obj.velocity += totalAcc;
-                obj.posRadius += vec4(obj.velocity, 0.0f);
+    void setMode(Pacing m)
+    {
+        mode = m;
+        glfwSwapInterval(m == Pacing::VSync || m == Pacing::Eco ? 1 : 0);
+        deadline = glfwGetTime();
+    }
+
+    // Top of the loop: waits as the mode asks. `idle` if the last frame changed nothing, `polling`
+    // if something still needs per-frame attention (e.g. tasks waiting on fences).
+    void beginFrame(bool idle, bool polling)
+    {
+        const double start = glfwGetTime();
+        if (frameStart != 0.0)
+        {
+            Usage& u = usage[static_cast<int>(mode)];
+            u.wall += start - frameStart;
+            u.cpu += std::max(0.0, start - frameStart - waited);
+            ++u.frames;
+        }
+        waited = 0.0;
+
+        AllocScope scope("pacing", true); // driver
+        if (mode == Pacing::Target)
+        {
+            const double period = 1.0 / targetFps;
+            deadline = std::max(deadline + period, start - period); // a late frame is not made up for
+            if (deadline - start > SPIN_SECONDS)
+                std::this_thread::sleep_for(std::chrono::duration<double>(deadline - start - SPIN_SECONDS));
+            while (glfwGetTime() < deadline)
+            {
             }
         }
+        else if (mode == Pacing::Eco && idle)
+        {
+            if (polling)
+                glfwWaitEventsTimeout(1.0 / 60.0);
+            else
+                glfwWaitEvents();
+        }
+        waited = glfwGetTime() - start;
+        frameStart = start;
+    }
 
-        // ---------- GRID ------------- //
-        // 2) rebuild grid mesh on CPU
-        engine.generateGrid(objects);
-        // 5) overlay the bent grid
-        mat4 view = glm::lookAt(camera.position(), camera.target, vec3(0, 1, 0));
-        mat4 proj = glm::perspective(glm::radians(60.0f), float(engine.COMPUTE_WIDTH) / engine.COMPUTE_HEIGHT, 1e9f, 1e14f);
-        mat4 viewProj = proj * view;
-        engine.drawGrid(viewProj);
+    // Around the frame's GL work
+    void beginGpu()
+    {
+        if (std::exchange(queryPending[query], false))
+        {
+            GLint available = 0;
+            glGetQueryObjectiv(queries[query], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available)
+            {
+                GLuint64 ns = 0;
+                glGetQueryObjectui64v(queries[query], GL_QUERY_RESULT, &ns);
+                Usage& u = usage[static_cast<int>(queryMode[query])];
+                u.gpu += double(ns) * 1e-9;
+                ++u.gpuFrames;
+            }
+        }
+        glBeginQuery(GL_TIME_ELAPSED, queries[query]);
+    }
 
-        // ---------- RUN RAYTRACER ------------- //
-        glViewport(0, 0, engine.WIDTH, engine.HEIGHT);
-        engine.dispatchCompute(camera);
-        engine.drawFullScreenQuad();
+    void endGpu()
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        queryPending[query] = true;
+        queryMode[query] = mode;
+        query = (query + 1) % GPU_QUERIES;
+    }
 
-        // 6) present to screen
-        glfwSwapBuffers(engine.window);
-        glfwPollEvents();
+    void swap(GLFWwindow* window)
+    {
+        const double start = glfwGetTime();
+        glfwSwapBuffers(window);
+        waited += glfwGetTime() - start;
+    }
+
+    void print(Pacing m) const
+    {
+        const Usage& u = usage[static_cast<int>(m)];
+        if (u.frames == 0 || u.wall <= 0.0)
+            return;
+        const double gpuBusy = u.gpuFrames ? u.gpu / u.gpuFrames * u.frames / u.wall : 0.0;
+        std::cout << std::format("\n[PACING] {}: {:.1f} fps over {:.1f} s, CPU busy {:.0f}%, GPU busy {:.0f}%\n",
+                                 PACING_NAMES[static_cast<int>(m)], u.frames / u.wall, u.wall, 100.0 * u.cpu / u.wall, 100.0 * gpuBusy);
+    }
+};
+
+// Resumes once the GPU has passed `fence`, checked once per frame
+auto gpuFence(TaskScheduler& tasks, GLsync fence)
+{
+    return tasks.until([fence] { return glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) != GL_TIMEOUT_EXPIRED; });
+}
+
+// Saves the back buffer as a binary PPM without stalling the loop: the read lands in a pixel
+// buffer, the rows are flipped on the job system, and the file is written on the I/O thread.
+// Spawn it after the frame is drawn and before the swap.
+Task saveScreenshot(TaskScheduler& tasks, int width, int height, std::filesystem::path path)
+{
+    const size_t rowBytes = size_t(width) * 3;
+    const size_t bytes = rowBytes * height;
+
+    GLuint pbo;
+    glGenBuffers(1, &pbo);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+    glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    co_await gpuFence(tasks, fence);
+    glDeleteSync(fence);
+
+    std::vector<std::byte> pixels(bytes);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+    glGetBufferSubData(GL_PIXEL_PACK_BUFFER, 0, bytes, pixels.data());
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glDeleteBuffers(1, &pbo);
+
+    // GL rows run bottom-up, PPM rows top-down
+    const std::string header = std::format("P6\n{} {}\n255\n", width, height);
+    std::vector<std::byte> file(header.size() + bytes);
+    co_await tasks.offload(pool, [&]
+                           {
+                               std::memcpy(file.data(), header.data(), header.size());
+                               pool.parallelFor(height, [&](size_t begin, size_t end)
+                                                {
+                                                    for (size_t y = begin; y < end; ++y)
+                                                        std::memcpy(file.data() + header.size() + y * rowBytes,
+                                                                    pixels.data() + (height - 1 - y) * rowBytes, rowBytes); }); });
+
+    const bool ok = co_await tasks.writeFile(path, file);
+    std::cout << (ok ? "\n[INFO] Saved " : "\n[ERROR] Could not write ") << path.string() << '\n';
+}
+
+// Records the presented frames as video without stalling the loop. Each captured frame is
+// blitted, flipped to top-down rows, into a fixed-size target and read into the next pixel buffer
+// of a small ring; a few frames later, once its fence has passed, the buffer is mapped and copied
+// into a frame of the VideoEncoder, which converts and writes it on its own thread. A frame is
+// dropped, and counted, only when every buffer of the ring is still in flight.
+struct VideoCapture
+{
+    static constexpr int SLOTS = 3;
+
+    struct Slot
+    {
+        GLuint pbo = 0;
+        GLsync fence = nullptr; // set while the read is in flight
+    };
+
+    std::unique_ptr<VideoEncoder> encoder;
+    int width = 0, height = 0;
+    double period = 0.0, next = 0.0;
+    GLuint fbo = 0, color = 0;
+    std::array<Slot, SLOTS> slots{};
+    int oldest = 0, inFlight = 0;
+    uint64_t captured = 0, dropped = 0;
+    double started = 0.0;
+
+    bool active() const
+    {
+        return encoder != nullptr;
+    }
+
+    // Records at `fps`, at most one frame per loop iteration, `w` x `h` regardless of the window
+    bool start(const std::string& path, int w, int h, int fps)
+    {
+        const VideoFormat format = path.ends_with(".rgb") ? VideoFormat::RGB : VideoFormat::Y4M;
+        auto e = std::make_unique<VideoEncoder>(pool, format, w, h, fps);
+        if (!e->open(path))
+        {
+            std::cerr << "\n[ERROR] Could not open video output: " << path << '\n';
+            return false;
+        }
+        encoder = std::move(e);
+        width = w;
+        height = h;
+        period = 1.0 / fps;
+        next = started = glfwGetTime();
+        captured = dropped = 0;
+
+        glGenRenderbuffers(1, &color);
+        glBindRenderbuffer(GL_RENDERBUFFER, color);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        for (Slot& slot : slots)
+        {
+            glGenBuffers(1, &slot.pbo);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+            glBufferData(GL_PIXEL_PACK_BUFFER, size_t(w) * h * 3, nullptr, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        std::cout << std::format("\n[VIDEO] Recording {}x{} at {} fps as {} to {}\n", w, h, fps,
+                                 format == VideoFormat::RGB ? "rgb24" : "Y4M", path);
+        return true;
+    }
+
+    // After the frame is drawn and before the swap; `srcWidth` x `srcHeight` is the back buffer
+    void capture(double now, int srcWidth, int srcHeight)
+    {
+        if (!encoder)
+            return;
+        collect(false);
+        if (now < next)
+            return;
+        next = std::max(next + period, now - period); // a late frame is not made up for
+        if (inFlight == SLOTS)
+        {
+            ++dropped;
+            return;
+        }
+
+        Slot& slot = slots[(oldest + inFlight) % SLOTS];
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+        glBlitFramebuffer(0, 0, srcWidth, srcHeight, 0, height, width, 0, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        ++inFlight;
+        ++captured;
+    }
+
+    // Hands finished reads to the encoder, oldest first; `wait` blocks on the GPU and the writer
+    void collect(bool wait)
+    {
+        while (inFlight > 0)
+        {
+            Slot& slot = slots[oldest];
+            const GLuint64 timeout = wait ? GL_TIMEOUT_IGNORED : 0;
+            if (glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout) == GL_TIMEOUT_EXPIRED)
+                return;
+            int frame;
+            std::byte* dst = encoder->acquire(frame);
+            while (!dst && wait)
+            {
+                std::this_thread::yield();
+                dst = encoder->acquire(frame);
+            }
+            if (!dst)
+                return; // the writer is behind; the read stays in the ring
+            glDeleteSync(slot.fence);
+            slot.fence = nullptr;
+
+            const size_t bytes = size_t(width) * height * 3;
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+            const auto* src = static_cast<const std::byte*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT));
+            pool.parallelFor(bytes, [&](size_t begin, size_t end) { std::memcpy(dst + begin, src + begin, end - begin); });
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            encoder->submit(frame);
+
+            oldest = (oldest + 1) % SLOTS;
+            --inFlight;
+        }
+    }
+
+    // Flushes the frames in flight, closes the output and reports
+    void stop()
+    {
+        if (!encoder)
+            return;
+        collect(true);
+        encoder->close();
+        const VideoEncoder::Stats stats = encoder->snapshot();
+        const double seconds = glfwGetTime() - started;
+        std::cout << std::format("\n[VIDEO] {} frames ({} dropped) in {:.1f} s to {}: {:.1f} MB, {:.2f} ms per frame to encode{}\n",
+                                 stats.frames, dropped, seconds, encoder->target, stats.bytes / 1e6,
+                                 stats.frames ? stats.encodeSeconds / stats.frames * 1e3 : 0.0,
+                                 encoder->failed ? ", WRITE FAILED" : "");
+        for (Slot& slot : slots)
+            glDeleteBuffers(1, &slot.pbo);
+        slots = {};
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteRenderbuffers(1, &color);
+        fbo = color = 0;
+        oldest = inFlight = 0;
+        encoder.reset();
+    }
+};
+
+// Traced RGBA, rows bottom-up as GL reads them, to RGB over black as composited on screen, rows
+// top-down as image files store them. Strides are in pixels.
+void compositeOverBlack(const uint8_t* rgba, int rgbaStride, uint8_t* rgb, int rgbStride, int width, int height)
+{
+    for (int row = 0; row < height; ++row)
+    {
+        const uint8_t* p = rgba + size_t(height - 1 - row) * rgbaStride * 4;
+        uint8_t* q = rgb + size_t(row) * rgbStride * 3;
+        for (int x = 0; x < width; ++x, p += 4, q += 3)
+            for (int c = 0; c < 3; ++c)
+                q[c] = uint8_t((p[c] * p[3] + 127) / 255);
+    }
+}
+
+// Like compositeOverBlack for an image traced at s x s rays per output pixel, box filtered
+void resolveSupersampled(const uint8_t* rgba, int s, uint8_t* rgb, int width, int height)
+{
+    if (s == 1)
+    {
+        compositeOverBlack(rgba, width, rgb, width, width, height);
+        return;
+    }
+    const int traceWidth = width * s;
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            int sum[3] = {};
+            for (int sy = 0; sy < s; ++sy)
+            {
+                const uint8_t* p = rgba + (size_t((height - 1 - y) * s + sy) * traceWidth + size_t(x) * s) * 4;
+                for (int sx = 0; sx < s; ++sx, p += 4)
+                    for (int c = 0; c < 3; ++c)
+                        sum[c] += p[c] * p[3];
+            }
+            for (int c = 0; c < 3; ++c)
+                rgb[(size_t(y) * width + x) * 3 + c] = uint8_t((sum[c] + 255 * s * s / 2) / (255 * s * s));
+        }
+    }
+}
+
+// A still larger than any one dispatch could trace, written as a binary PPM
+struct PosterSpec
+{
+    int width = 7680, height = 4320;
+    std::filesystem::path path = "poster.ppm";
+    int tile = 256;         // edge of a tile, the most traced at once
+    int tilesPerFrame = 2;  // adjacent tiles of one row, traced and written together
+};
+
+// Head of "<poster>.tiles", followed by one byte per tile, set once the tile is on disk
+struct PosterProgress
+{
+    char magic[8] = {'B', 'H', 'P', 'O', 'S', 'T', 'E', 'R'};
+    int32_t width = 0, height = 0, tile = 0;
+    float radius = 0.0f, azimuth = 0.0f, elevation = 0.0f; // the camera, which a resume keeps
+};
+
+// Traces a poster a few tiles per frame while the interactive view keeps running, streaming each
+// strip of tiles into its place in the file. GPU memory stays at one tile plus the readback of a
+// frame's tiles. The bodies are frozen as they were at the start, and the GPU traces the next strip
+// while the last one is being written. An interrupted poster resumes from its progress file, with
+// the camera it started with.
+Task renderPoster(TaskScheduler& tasks, Engine& engine, PosterSpec spec, Camera camera, bool& running)
+{
+    running = true;
+    if (spec.width <= 0 || spec.height <= 0 || spec.tile <= 0 || spec.tilesPerFrame <= 0)
+    {
+        std::cerr << std::format("\n[ERROR] Poster size {}x{} has no tiles\n", spec.width, spec.height);
+        running = false;
+        co_return;
+    }
+    const int columns = (spec.width + spec.tile - 1) / spec.tile;
+    const int rows = (spec.height + spec.tile - 1) / spec.tile;
+    const size_t tileCount = size_t(columns) * rows;
+    const std::string header = std::format("P6\n{} {}\n255\n", spec.width, spec.height);
+    const uint64_t imageBytes = header.size() + uint64_t(spec.width) * spec.height * 3;
+    std::filesystem::path progressPath = spec.path;
+    progressPath += ".tiles";
+
+    PosterProgress progress;
+    std::vector<std::byte> saved;
+    const bool readable = co_await tasks.readFile(progressPath, saved);
+    std::error_code error;
+    PosterProgress head;
+    if (readable && saved.size() == sizeof(PosterProgress) + tileCount)
+        std::memcpy(&head, saved.data(), sizeof(head));
+    const bool resume = readable && saved.size() == sizeof(PosterProgress) + tileCount &&
+                        std::memcmp(head.magic, progress.magic, sizeof(progress.magic)) == 0 &&
+                        head.width == spec.width && head.height == spec.height && head.tile == spec.tile &&
+                        std::filesystem::file_size(spec.path, error) == imageBytes;
+    std::vector<uint8_t> done(tileCount, 0);
+    if (resume)
+    {
+        progress = head;
+        std::memcpy(done.data(), saved.data() + sizeof(PosterProgress), tileCount);
+        camera.radius = progress.radius;
+        camera.azimuth = progress.azimuth;
+        camera.elevation = progress.elevation;
+    }
+    else
+    {
+        progress.width = spec.width;
+        progress.height = spec.height;
+        progress.tile = spec.tile;
+        progress.radius = camera.radius;
+        progress.azimuth = camera.azimuth;
+        progress.elevation = camera.elevation;
+        {
+            std::ofstream image(spec.path, std::ios::binary | std::ios::trunc);
+            image.write(header.data(), std::streamsize(header.size()));
+        }
+        std::filesystem::resize_file(spec.path, imageBytes, error); // sparse where the filesystem allows
+        saved.assign(sizeof(PosterProgress) + tileCount, std::byte{0});
+        std::memcpy(saved.data(), &progress, sizeof(progress));
+        if (error || !co_await tasks.writeFile(progressPath, saved))
+        {
+            std::cerr << "\n[ERROR] Could not create poster " << spec.path.string() << '\n';
+            running = false;
+            co_return;
+        }
+    }
+    camera.dragging = camera.panning = camera.moving = false;
+    size_t tilesDone = size_t(std::count(done.begin(), done.end(), uint8_t(1)));
+    std::cout << std::format("\n[POSTER] {} {}x{} in {} tiles of {}{}\n", resume ? "Resuming" : "Rendering", spec.width, spec.height,
+                             tileCount, spec.tile, resume ? std::format(", {} already done", tilesDone) : "");
+
+    // One tile to trace into, the readback of one strip, and the bodies as they are now
+    const size_t tileTexels = size_t(spec.tile) * spec.tile;
+    GLuint texture, pbo;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, spec.tile, spec.tile, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glGenBuffers(1, &pbo);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+    glBufferData(GL_PIXEL_PACK_BUFFER, tileTexels * 4 * spec.tilesPerFrame, nullptr, GL_STREAM_READ);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    const GLuint objects = engine.copyObjectsUBO();
+
+    std::vector<std::byte> strip(tileTexels * 3 * spec.tilesPerFrame);
+    const std::vector<std::byte> marks(spec.tilesPerFrame, std::byte{1});
+
+    // Up to tilesPerFrame tiles [first, first + count), not yet done, of one tile row
+    struct Strip
+    {
+        size_t first = 0;
+        int count = 0;
+        int x = 0, y = 0, width = 0, height = 0;
+    };
+    auto nextStrip = [&](size_t from)
+    {
+        Strip b;
+        while (from < tileCount && done[from])
+            ++from;
+        if (from == tileCount)
+            return b;
+        b.first = from;
+        while (b.count < spec.tilesPerFrame && from < tileCount && !done[from] && (from % columns != 0 || b.count == 0))
+        {
+            ++b.count;
+            ++from;
+        }
+        b.x = int(b.first % columns) * spec.tile;
+        b.y = int(b.first / columns) * spec.tile;
+        b.width = std::min(b.count * spec.tile, spec.width - b.x);
+        b.height = std::min(spec.tile, spec.height - b.y);
+        return b;
+    };
+    const float aspect = float(spec.width) / float(spec.height);
+    auto trace = [&](const Strip& b)
+    {
+        glBindBufferBase(GL_UNIFORM_BUFFER, 3, objects);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        for (int k = 0; k < b.count; ++k)
+        {
+            const int x = b.x + k * spec.tile;
+            engine.traceRegion(camera, aspect, texture, x, b.y, std::min(spec.tile, spec.width - x), b.height, spec.width, spec.height);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, reinterpret_cast<void*>(k * tileTexels * 4));
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, 3, engine.objectsUBO);
+        return glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    };
+
+    const double start = glfwGetTime();
+    double pixelsTraced = 0.0;
+    size_t reported = tilesDone * 10 / tileCount;
+    bool ok = true;
+    Strip next = nextStrip(0);
+    GLsync fence = next.count ? trace(next) : nullptr;
+    while (next.count > 0)
+    {
+        co_await gpuFence(tasks, fence);
+        glDeleteSync(fence);
+
+        const Strip b = next;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+        const auto* texels = static_cast<const uint8_t*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, tileTexels * 4 * b.count, GL_MAP_READ_BIT));
+        auto* out = reinterpret_cast<uint8_t*>(strip.data());
+        for (int k = 0; k < b.count; ++k)
+            compositeOverBlack(texels + k * tileTexels * 4, spec.tile, out + size_t(k) * spec.tile * 3, b.width,
+                               std::min(spec.tile, b.width - k * spec.tile), b.height);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        next = nextStrip(b.first + b.count);
+        fence = next.count ? trace(next) : nullptr;
+
+        const uint64_t fileRow = uint64_t(spec.height - b.y - b.height);
+        const std::span<const std::byte> pixels(strip.data(), size_t(b.width) * b.height * 3);
+        ok = co_await tasks.writeRows(spec.path, pixels, header.size() + (fileRow * spec.width + b.x) * 3, size_t(b.width) * 3, uint64_t(spec.width) * 3);
+        ok = ok && co_await tasks.writeRows(progressPath, std::span(marks.data(), b.count), sizeof(PosterProgress) + b.first, b.count, 0);
+        if (!ok)
+        {
+            if (fence)
+                glDeleteSync(fence);
+            break;
+        }
+        tilesDone += b.count;
+        pixelsTraced += double(b.width) * b.height;
+        if (tilesDone * 10 / tileCount != reported)
+        {
+            reported = tilesDone * 10 / tileCount;
+            std::cout << std::format("\n[POSTER] {}% ({} of {} tiles)\n", reported * 10, tilesDone, tileCount);
+        }
+    }
+
+    glDeleteTextures(1, &texture);
+    glDeleteBuffers(1, &pbo);
+    glDeleteBuffers(1, &objects);
+    const double seconds = glfwGetTime() - start;
+    if (ok)
+        std::cout << std::format("\n[POSTER] Saved {} in {:.1f} s, {:.2f} Mpixel/s\n", spec.path.string(), seconds, seconds > 0.0 ? pixelsTraced / seconds * 1e-6 : 0.0);
+    else
+        std::cerr << "\n[ERROR] Could not write poster " << spec.path.string() << "; run it again to resume\n";
+    running = false;
+}
+
+// Saves the view's color and AOVs at window size as a multi-layer EXR, tracing a band of rows
+// per frame so the loop never traces more than a fraction of the image at once. The bodies are
+// frozen for the whole image, the readback waits on a fence, and the EXR is encoded on the job
+// system and written on the I/O thread.
+Task saveAovs(TaskScheduler& tasks, Engine& engine, Camera camera, int width, int height, std::filesystem::path path)
+{
+    constexpr int BAND = 32; // rows per frame
+    camera.dragging = camera.panning = camera.moving = false;
+    const float aspect = float(width) / float(height);
+    const size_t planeBytes = size_t(width) * BAND * 4 * sizeof(float);
+
+    AovTargets targets;
+    targets.create(width, BAND);
+    GLuint pbo;
+    glGenBuffers(1, &pbo);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+    glBufferData(GL_PIXEL_PACK_BUFFER, planeBytes * (1 + AOV_TARGETS), nullptr, GL_STREAM_READ);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    const GLuint objects = engine.copyObjectsUBO();
+
+    AovImage image;
+    image.resize(width, height);
+    for (int y = 0; y < height; y += BAND)
+    {
+        const int rows = std::min(BAND, height - y);
+        glBindBufferBase(GL_UNIFORM_BUFFER, 3, objects);
+        engine.traceRegion(camera, aspect, targets.color, 0, y, width, rows, width, height, targets.aovs.data());
+        glBindBufferBase(GL_UNIFORM_BUFFER, 3, engine.objectsUBO);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+        targets.read(width, BAND, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        co_await gpuFence(tasks, fence);
+        glDeleteSync(fence);
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+        const auto* mapped = static_cast<const std::byte*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, planeBytes * (1 + AOV_TARGETS), GL_MAP_READ_BIT));
+        const size_t bandBytes = size_t(width) * rows * 4 * sizeof(float);
+        for (int plane = 0; plane <= AOV_TARGETS; ++plane)
+            std::memcpy(image.data.data() + plane * image.planeFloats() + size_t(y) * width * 4, mapped + plane * planeBytes, bandBytes);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+    targets.destroy();
+    glDeleteBuffers(1, &pbo);
+    glDeleteBuffers(1, &objects);
+
+    std::vector<std::byte> file;
+    co_await tasks.offload(pool, [&] { image.encodeExr(file); });
+    const bool ok = co_await tasks.writeFile(path, file);
+    std::cout << (ok ? "\n[INFO] Saved " : "\n[ERROR] Could not write ") << path.string() << '\n';
+}
+
+// Original CPU grid build: scalar nested loop in double, into fresh vectors
+void referenceGrid(int gridSize, float spacing, const std::vector<ObjectData>& bodies, std::vector<vec3>& vertices)
+{
+    vertices.clear();
+    for (int z = 0; z <= gridSize; ++z)
+    {
+        for (int x = 0; x <= gridSize; ++x)
+        {
+            const float worldX = (x - gridSize / 2) * spacing;
+            const float worldZ = (z - gridSize / 2) * spacing;
+
+            float y = 0.0f;
+            for (const auto& obj : bodies)
+            {
+                const vec3 objPos = vec3(obj.posRadius);
+                const double r_s = 2.0 * G * obj.mass / (C * C);
+                const double dx = worldX - objPos.x;
+                const double dz = worldZ - objPos.z;
+                const double dist = std::sqrt(dx * dx + dz * dz);
+                y += dist > r_s ? static_cast<float>(2.0 * std::sqrt(r_s * (dist - r_s))) - 3e10f : 2.0f * static_cast<float>(r_s) - 3e10f;
+            }
+            vertices.emplace_back(worldX, y, worldZ);
+        }
+    }
+}
+
+// --bench-grid: full CPU grid builds, original scalar loop vs CpuGrid's parallel SIMD rebuild
+int benchGrid()
+{
+    auto bestOf = [](int runs, auto&& fn)
+    {
+        double best = 1e30;
+        for (int i = 0; i < runs; ++i)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            fn();
+            best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+        return best;
+    };
+
+    std::cout << std::format("{} threads, SIMD {}\n", pool.size(), CPU_GRID_SIMD ? "SSE2" : "off");
+    std::cout << std::format("{:>6} {:>7} {:>12} {:>12} {:>8}\n", "cells", "bodies", "scalar ms", "simd ms", "speedup");
+
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> place(-4e11f, 4e11f);
+    for (int cells : {128, 512, 1024, 2048})
+    {
+        for (size_t count : {size_t(5), size_t(16), size_t(64)})
+        {
+            std::vector<ObjectData> bodies = sceneObjects;
+            while (bodies.size() < count)
+                bodies.push_back({vec4(place(rng), 0.0f, place(rng), 4e10f), vec4(1), 1e30f});
+            std::vector<CpuGrid::Body> gridBodies;
+            for (const auto& obj : bodies)
+                gridBodies.push_back({obj.posRadius.x, obj.posRadius.z, static_cast<float>(2.0 * G * obj.mass / (C * C))});
+
+            const float spacing = 2.56e11f / cells;
+            const int runs = cells >= 1024 ? 3 : 10;
+            std::vector<vec3> reference;
+            const double scalar = bestOf(runs, [&] { referenceGrid(cells, spacing, bodies, reference); });
+
+            CpuGrid grid(cells, spacing);
+            std::vector<float> mapped(size_t(grid.side()) * grid.side() * 3); // stands in for the mapped buffer
+            const double simd = bestOf(runs, [&]
+                                       {
+                                           grid.rebuild(pool, gridBodies);
+                                           grid.writeVertices(pool, mapped.data()); });
+
+            std::cout << std::format("{:>6} {:>7} {:>12.3f} {:>12.3f} {:>7.1f}x\n", cells, count, scalar * 1e3, simd * 1e3, scalar / simd);
+        }
+    }
+    return 0;
+}
+
+// The whole of `text` as a number; `value` is left alone if it is not one
+template <typename T>
+bool parseNumber(std::string_view text, T& value)
+{
+    T parsed;
+    const auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), parsed);
+    if (ec != std::errc{} || end != text.data() + text.size())
+        return false;
+    value = parsed;
+    return true;
+}
+
+// "WxH", or "W" for 16:9; `width` and `height` are left alone unless both parse and are positive
+bool parseSize(std::string_view text, int& width, int& height)
+{
+    const size_t x = text.find('x');
+    int w = 0, h = 0;
+    if (!parseNumber(text.substr(0, x), w))
+        return false;
+    if (x == std::string_view::npos)
+        h = w * 9 / 16;
+    else if (!parseNumber(text.substr(x + 1), h))
+        return false;
+    if (w <= 0 || h <= 0)
+        return false;
+    width = w;
+    height = h;
+    return true;
+}
+
+// The bodies for the headless paths: a snapshot's, or the built-in scene's
+bool loadBodies(const std::filesystem::path& restorePath)
+{
+    if (restorePath.empty())
+    {
+        addObjects(objects, sceneObjects);
+        return true;
+    }
+    uint64_t step;
+    if (!restoreSnapshot(restorePath, objects, tracers, step))
+    {
+        std::cerr << "Failed to restore snapshot: " << restorePath.string() << '\n';
+        return false;
+    }
+    return true;
+}
+
+// What a traced frame depends on besides the camera: the bodies as loaded, the disk, and the
+// tracer's source. Keys cached or resumed work, so neither outlives a scene change or a shader edit.
+uint64_t sceneHash(const BodyRegistry& bodies)
+{
+    uint64_t hash = fnv1a(&SagA.r_s, sizeof(SagA.r_s));
+    for (size_t i = 0; i < std::min(bodies.size(), size_t{16}); ++i)
+    {
+        const float body[] = {bodies.x[i], bodies.y[i], bodies.z[i], bodies.radius[i], bodies.mass[i]};
+        hash = fnv1a(body, sizeof(body), hash);
+        hash = fnv1a(&bodies.color[i], sizeof(bodies.color[i]), hash);
+    }
+    std::ifstream shader("geodesic.comp", std::ios::binary);
+    const std::string source((std::istreambuf_iterator<char>(shader)), std::istreambuf_iterator<char>());
+    return fnv1a(source.data(), source.size(), hash);
+}
+
+// What the headless paths trace into: a texture, attached to a framebuffer to read it back from
+struct Offscreen
+{
+    GLuint color = 0, fbo = 0;
+
+    bool create(int width, int height)
+    {
+        glGenTextures(1, &color);
+        glBindTexture(GL_TEXTURE_2D, color);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cerr << "Headless framebuffer incomplete\n";
+            return false;
+        }
+        return true;
+    }
+
+    // The traced RGBA, rows bottom-up
+    void read(int width, int height, uint8_t* rgba) const
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+    }
+
+    void destroy()
+    {
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteTextures(1, &color);
+        fbo = color = 0;
+    }
+};
+
+// --headless: one camera, traced into an offscreen framebuffer with no window or display
+struct HeadlessSpec
+{
+    int width = 640, height = 360;
+    int frames = 5; // traced back to back for the throughput figure; the last one is saved
+    float radius = Camera{}.radius, azimuth = Camera{}.azimuth, elevation = Camera{}.elevation;
+    std::filesystem::path output; // binary PPM, nothing if empty
+    bool aovs = false;            // also the AOVs, as an EXR next to the output
+};
+
+int runHeadless(const HeadlessSpec& spec, const std::filesystem::path& restorePath)
+{
+    Engine engine(true);
+    engine.WIDTH = spec.width;
+    engine.HEIGHT = spec.height;
+
+    if (!loadBodies(restorePath))
+        return EXIT_FAILURE;
+    engine.uploadObjectsUBO(objects);
+    engine.uploadDiskUBO();
+
+    Camera camera;
+    camera.radius = spec.radius;
+    camera.azimuth = spec.azimuth;
+    camera.elevation = spec.elevation;
+
+    Offscreen target;
+    if (!target.create(spec.width, spec.height))
+        return EXIT_FAILURE;
+
+    // The first dispatch pays for shader compilation and warm-up, so it is not timed
+    const float aspect = float(spec.width) / float(spec.height);
+    auto traceFrame = [&]
+    {
+        engine.traceRegion(camera, aspect, target.color, 0, 0, spec.width, spec.height, spec.width, spec.height);
+        glFinish();
+    };
+    traceFrame();
+    std::vector<double> seconds;
+    for (int i = 0; i < spec.frames; ++i)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        traceFrame();
+        seconds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    if (!spec.output.empty())
+    {
+        std::vector<uint8_t> rgba(size_t(spec.width) * spec.height * 4);
+        target.read(spec.width, spec.height, rgba.data());
+        const std::string header = std::format("P6\n{} {}\n255\n", spec.width, spec.height);
+        std::vector<uint8_t> rgb(size_t(spec.width) * spec.height * 3);
+        compositeOverBlack(rgba.data(), spec.width, rgb.data(), spec.width, spec.width, spec.height);
+        std::ofstream file(spec.output, std::ios::binary | std::ios::trunc);
+        file.write(header.data(), std::streamsize(header.size()));
+        file.write(reinterpret_cast<const char*>(rgb.data()), std::streamsize(rgb.size()));
+        if (!file.flush())
+        {
+            std::cerr << "Failed to write " << spec.output.string() << '\n';
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Once more with the AOVs, untimed
+    if (spec.aovs)
+    {
+        AovTargets aov;
+        aov.create(spec.width, spec.height);
+        engine.traceRegion(camera, aspect, aov.color, 0, 0, spec.width, spec.height, spec.width, spec.height, aov.aovs.data());
+        AovImage image;
+        image.resize(spec.width, spec.height);
+        aov.read(spec.width, spec.height, reinterpret_cast<std::byte*>(image.data.data()));
+        aov.destroy();
+
+        std::filesystem::path exrPath = spec.output.empty() ? std::filesystem::path("aov.exr") : std::filesystem::path(spec.output).replace_extension(".exr");
+        std::vector<std::byte> exr;
+        image.encodeExr(exr);
+        std::ofstream file(exrPath, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(exr.data()), std::streamsize(exr.size()));
+        if (!file.flush())
+        {
+            std::cerr << "Failed to write " << exrPath.string() << '\n';
+            return EXIT_FAILURE;
+        }
+        std::cout << "[HEADLESS] AOVs -> " << exrPath.string() << '\n';
+    }
+
+    if (!seconds.empty())
+    {
+        const double total = std::accumulate(seconds.begin(), seconds.end(), 0.0);
+        const double pixels = double(spec.width) * spec.height * spec.frames;
+        std::cout << std::format("[HEADLESS] {} frames of {}x{}: {:.2f} fps, {:.1f} ms mean, {:.1f} ms best, {:.2f} Mpixel/s{}\n",
+                                 spec.frames, spec.width, spec.height, spec.frames / total, total / spec.frames * 1e3,
+                                 *std::min_element(seconds.begin(), seconds.end()) * 1e3, pixels / total * 1e-6,
+                                 spec.output.empty() ? "" : " -> " + spec.output.string());
+    }
+
+    target.destroy();
+    engine.destroyHeadlessContext();
+    return 0;
+}
+
+// Keyframed camera and simulation settings for --animate. One setting or keyframe per line, and
+// '#' starts a comment:
+//
+//   fps 30
+//   size 1920x1080      // overridden by --size
+//   supersample 2       // 2x2 rays per pixel
+//   gravity on          // bodies move, Simulation::RATE steps per second of animation
+//   solver direct       // or mesh
+//   aov on              // also frame-NNNNN.exr with the AOVs, as does --aov
+//   0  1.38e11 2.35 1.5 // time (s), radius (m), azimuth and elevation (rad), in time order
+//   8  8.0e10  4.0 1.3
+struct CameraPath
+{
+    struct Key
+    {
+        double time;
+        float radius, azimuth, elevation;
+    };
+
+    std::vector<Key> keys;
+    int fps = 30;
+    int width = 1280, height = 720;
+    int supersample = 1;
+    bool gravity = false;
+    Solver solver = Solver::Direct;
+    bool aovs = false;
+    uint64_t hash = fnv1a(nullptr, 0); // of the file, so a resume can tell it is unchanged
+
+    bool load(const std::filesystem::path& path, std::string& text, std::string& error)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+        {
+            error = "cannot open " + path.string();
+            return false;
+        }
+        text.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        return parse(text, path.string(), error);
+    }
+
+    // The file's contents; `name` is for errors
+    bool parse(const std::string& text, const std::string& name, std::string& error)
+    {
+        std::istringstream file(text);
+        std::string line;
+        for (int number = 1; std::getline(file, line); ++number)
+        {
+            hash = fnv1a(line.data(), line.size(), hash);
+            std::istringstream in(line.substr(0, line.find('#')));
+            std::string word;
+            if (!(in >> word))
+                continue;
+            bool ok = true;
+            if (word == "fps")
+                ok = bool(in >> fps) && fps > 0;
+            else if (word == "size")
+                ok = bool(in >> word) && parseSize(word, width, height);
+            else if (word == "supersample")
+                ok = bool(in >> supersample) && supersample > 0;
+            else if (word == "gravity")
+            {
+                ok = bool(in >> word) && (word == "on" || word == "off");
+                gravity = word == "on";
+            }
+            else if (word == "solver")
+            {
+                ok = bool(in >> word) && (word == "mesh" || word == "direct");
+                solver = word == "mesh" ? Solver::ParticleMesh : Solver::Direct;
+            }
+            else if (word == "aov")
+            {
+                ok = bool(in >> word) && (word == "on" || word == "off");
+                aovs = word == "on";
+            }
+            else
+            {
+                Key key{};
+                std::istringstream keyLine(line.substr(0, line.find('#')));
+                ok = bool(keyLine >> key.time >> key.radius >> key.azimuth >> key.elevation) && (keys.empty() || key.time > keys.back().time);
+                keys.push_back(key);
+            }
+            if (!ok)
+            {
+                error = std::format("{}:{}: cannot read \"{}\"", name, number, line);
+                return false;
+            }
+        }
+        if (keys.empty())
+        {
+            error = name + ": no keyframes";
+            return false;
+        }
+        return true;
+    }
+
+    int frameCount() const
+    {
+        return int(std::floor(keys.back().time * fps)) + 1;
+    }
+
+    // Catmull-Rom through the keyframes, held before the first and after the last
+    Key at(double t) const
+    {
+        size_t k = 0;
+        while (k + 2 < keys.size() && keys[k + 1].time <= t)
+            ++k;
+        if (keys.size() == 1 || t <= keys.front().time)
+            return keys.front();
+        if (t >= keys.back().time)
+            return keys.back();
+        const Key& p0 = keys[k > 0 ? k - 1 : 0];
+        const Key& p1 = keys[k];
+        const Key& p2 = keys[k + 1];
+        const Key& p3 = keys[std::min(k + 2, keys.size() - 1)];
+        const float u = float((t - p1.time) / (p2.time - p1.time));
+        auto spline = [u](float a, float b, float c, float d)
+        {
+            return 0.5f * (2.0f * b + (c - a) * u + (2.0f * a - 5.0f * b + 4.0f * c - d) * u * u + (3.0f * b - a - 3.0f * c + d) * u * u * u);
+        };
+        return {t, spline(p0.radius, p1.radius, p2.radius, p3.radius), spline(p0.azimuth, p1.azimuth, p2.azimuth, p3.azimuth),
+                spline(p0.elevation, p1.elevation, p2.elevation, p3.elevation)};
+    }
+
+    // Simulation step shown by `frame`
+    uint64_t stepAt(int frame) const
+    {
+        return uint64_t(std::llround(frame * Simulation::RATE / fps));
+    }
+
+    Camera cameraAt(int frame) const
+    {
+        const Key pose = at(double(frame) / fps);
+        Camera camera;
+        camera.radius = pose.radius;
+        camera.azimuth = pose.azimuth;
+        camera.elevation = pose.elevation;
+        return camera;
+    }
+
+    // The file, the settings that change its frames and the scene (sceneHash), for `AnimationProgress`
+    uint64_t key(uint64_t scene) const
+    {
+        const uint64_t settings = hash ^ (uint64_t(width) << 40 | uint64_t(height) << 16 | uint64_t(aovs) << 12 | uint64_t(supersample));
+        return fnv1a(&scene, sizeof(scene), settings);
+    }
+};
+
+// The bodies of a camera path at any of its frames, stepped from their state at construction,
+// which is deterministic. Seeking back replays from the latest of the last few frames seeked
+// that is not past the target, or from the start.
+struct PathReplay
+{
+    static constexpr size_t CHECKPOINTS = 4;
+
+    struct Checkpoint
+    {
+        uint64_t step;
+        BodyRegistry bodies;
+    };
+
+    const CameraPath& path;
+    BodyRegistry initial = objects;
+    Tracers massless{}; // the tracers are not traced, only the bodies
+    uint64_t step = 0;
+    std::vector<Checkpoint> checkpoints{}; // oldest first
+
+    // Steps `objects` to `frame` and uploads them
+    void seek(int frame, Engine& engine)
+    {
+        const uint64_t to = path.stepAt(frame);
+        if (!path.gravity || to == step)
+        {
+            engine.uploadObjectsUBO(objects);
+            return;
+        }
+        if (to < step)
+        {
+            auto from = std::find_if(checkpoints.rbegin(), checkpoints.rend(), [&](const Checkpoint& c) { return c.step <= to; });
+            objects = from == checkpoints.rend() ? initial : from->bodies;
+            step = from == checkpoints.rend() ? 0 : from->step;
+            engine.objectsSynced = 0;
+        }
+        else
+        {
+            if (checkpoints.size() == CHECKPOINTS)
+                checkpoints.erase(checkpoints.begin());
+            checkpoints.push_back({step, objects});
+        }
+        for (; step < to; ++step)
+            stepGravity(objects, massless, path.solver);
+        engine.uploadObjectsUBO(objects);
+    }
+};
+
+// "progress" in an animation's output directory: frames before `next` are on disk, rendered
+// from the path and settings hashed in `key`, so a killed job resumes where it stopped
+struct AnimationProgress
+{
+    std::filesystem::path dir;
+    uint64_t key;
+
+    // Where to start, 0 unless the last run had the same key
+    int load(int frames) const
+    {
+        std::ifstream progress(dir / "progress");
+        std::string magic;
+        uint64_t savedKey = 0;
+        int next = 0;
+        if (progress >> magic >> std::hex >> savedKey >> std::dec >> next && magic == "BHANIM" && savedKey == key)
+            return std::clamp(next, 0, frames);
+        return 0;
+    }
+
+    void save(int next) const
+    {
+        {
+            std::ofstream progress(dir / "progress.part", std::ios::trunc);
+            progress << "BHANIM " << std::hex << key << std::dec << ' ' << next << '\n';
+        }
+        std::error_code ignored;
+        std::filesystem::rename(dir / "progress.part", dir / "progress", ignored);
+    }
+};
+
+// A frame read back from the GPU, encoded and written as a job while the next one is traced
+struct AnimationFrame
+{
+    int width = 0, height = 0, supersample = 1;
+    std::vector<uint8_t> rgba;    // traced, supersampled, rows bottom-up
+    std::vector<uint8_t> rgb;     // output, rows top-down
+    std::vector<uint8_t> encoded; // QOI
+    AovImage aov;                 // traced with AOVs if sized, which also supplies `rgba`
+    std::vector<std::byte> exr;
+    std::filesystem::path path;
+    int frame = -1; // none in flight
+    bool ok = false;
+    double seconds = 0.0; // encoding and writing
+    size_t bytes = 0;
+    JobCounter counter;
+
+    void allocate(const CameraPath& path)
+    {
+        width = path.width;
+        height = path.height;
+        supersample = path.supersample;
+        const int traceWidth = width * supersample, traceHeight = height * supersample;
+        rgba.resize(size_t(traceWidth) * traceHeight * 4);
+        rgb.resize(size_t(width) * height * 3);
+        encoded.resize(qoiMaxSize(width, height, 3));
+        if (path.aovs)
+            aov.resize(traceWidth, traceHeight);
+    }
+
+    void operator()()
+    {
+        const auto start = std::chrono::steady_clock::now();
+        if (aov.width > 0)
+        {
+            for (size_t i = 0; i < rgba.size(); ++i)
+                rgba[i] = uint8_t(std::clamp(aov.data[i], 0.0f, 1.0f) * 255.0f + 0.5f);
+        }
+        resolveSupersampled(rgba.data(), supersample, rgb.data(), width, height);
+        bytes = qoiEncode(rgb.data(), width, height, 3, encoded.data());
+
+        ok = write(path, encoded.data(), bytes);
+        if (aov.width > 0)
+        {
+            aov.encodeExr(exr);
+            ok = write(std::filesystem::path(path).replace_extension(".exr"), exr.data(), exr.size()) && ok;
+            bytes += exr.size();
+        }
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Under a temporary name until complete, so a killed job never leaves a partial frame
+    static bool write(const std::filesystem::path& to, const void* data, size_t size)
+    {
+        std::filesystem::path partial = to;
+        partial += ".part";
+        bool ok;
+        {
+            std::ofstream file(partial, std::ios::binary | std::ios::trunc);
+            file.write(static_cast<const char*>(data), std::streamsize(size));
+            ok = bool(file.flush());
+        }
+        std::error_code error;
+        std::filesystem::rename(partial, to, error);
+        return ok && !error;
+    }
+};
+
+// --animate: every frame of a camera path, traced headless and written as numbered QOI images.
+// The GPU traces frame n + 1 while jobs encode and write the frames before it. `progress` in the
+// output directory holds the frames complete so far, so a killed job resumes where it stopped.
+int runAnimation(const std::filesystem::path& pathFile, const std::filesystem::path& dir, const int* size, bool aovs, const std::filesystem::path& restorePath)
+{
+    CameraPath path;
+    std::string text, error;
+    if (!path.load(pathFile, text, error))
+    {
+        std::cerr << error << '\n';
+        return EXIT_FAILURE;
+    }
+    if (size)
+    {
+        path.width = size[0];
+        path.height = size[1];
+    }
+    path.aovs = path.aovs || aovs;
+
+    Engine engine(true);
+    if (!loadBodies(restorePath))
+        return EXIT_FAILURE;
+    engine.uploadDiskUBO();
+    PathReplay replay{.path = path};
+
+    // Resume after the frames a previous run finished with the same path, settings and scene
+    std::filesystem::create_directories(dir);
+    const AnimationProgress progress{dir, path.key(sceneHash(objects))};
+    const int first = progress.load(path.frameCount());
+
+    const int frames = path.frameCount();
+    const int s = path.supersample;
+    const int traceWidth = path.width * s, traceHeight = path.height * s;
+    Offscreen target;
+    AovTargets aovTargets;
+    if (path.aovs)
+        aovTargets.create(traceWidth, traceHeight);
+    else if (!target.create(traceWidth, traceHeight))
+        return EXIT_FAILURE;
+    std::array<AnimationFrame, 3> slots;
+    for (AnimationFrame& slot : slots)
+        slot.allocate(path);
+
+    std::cout << std::format("[ANIMATE] {} frames of {}x{} ({}x supersampled) at {} fps to {}{}\n", frames, path.width, path.height,
+                             s, path.fps, dir.string(), first ? std::format(", resuming at frame {}", first) : "");
+    int written = 0;
+    size_t bytes = 0;
+    double encodeSeconds = 0.0;
+    bool ok = true;
+    auto finish = [&](AnimationFrame& slot)
+    {
+        if (slot.frame < 0)
+            return;
+        pool.wait(slot.counter);
+        if (!slot.ok)
+        {
+            std::cerr << "\n[ERROR] Could not write " << slot.path.string() << '\n';
+            ok = false;
+        }
+        else if (ok)
+        {
+            // Slots finish in frame order, so every frame before this one is on disk
+            progress.save(slot.frame + 1);
+            ++written;
+            bytes += slot.bytes;
+            encodeSeconds += slot.seconds;
+        }
+        slot.frame = -1;
+    };
+
+    const auto start = std::chrono::steady_clock::now();
+    int i = first;
+    for (; i < frames && ok; ++i)
+    {
+        AnimationFrame& slot = slots[i % slots.size()];
+        finish(slot);
+
+        replay.seek(i, engine);
+        const Camera camera = path.cameraAt(i);
+        const float aspect = float(path.width) / float(path.height);
+        if (path.aovs)
+        {
+            engine.traceRegion(camera, aspect, aovTargets.color, 0, 0, traceWidth, traceHeight, traceWidth, traceHeight, aovTargets.aovs.data());
+            aovTargets.read(traceWidth, traceHeight, reinterpret_cast<std::byte*>(slot.aov.data.data()));
+        }
+        else
+        {
+            engine.traceRegion(camera, aspect, target.color, 0, 0, traceWidth, traceHeight, traceWidth, traceHeight);
+            target.read(traceWidth, traceHeight, slot.rgba.data());
+        }
+
+        slot.frame = i;
+        slot.path = dir / std::format("frame-{:05}.qoi", i);
+        pool.run(slot.counter, slot);
+
+        if ((i + 1) % path.fps == 0)
+            std::cout << std::format("\r[ANIMATE] frame {} of {}", i + 1, frames) << std::flush;
+    }
+    for (size_t k = 0; k < slots.size(); ++k)
+        finish(slots[(i + k) % slots.size()]); // oldest first
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << std::format("\n[ANIMATE] {} frames in {:.1f} s: {:.2f} fps, {:.2f} Mpixel/s traced, {:.1f} ms per frame to encode, {:.1f} MB\n",
+                             written, seconds, seconds > 0.0 ? written / seconds : 0.0,
+                             seconds > 0.0 ? double(written) * traceWidth * traceHeight / seconds * 1e-6 : 0.0,
+                             written ? encodeSeconds / written * 1e3 : 0.0, bytes / 1e6);
+    target.destroy();
+    aovTargets.destroy();
+    engine.destroyHeadlessContext();
+    return ok ? 0 : EXIT_FAILURE;
+}
+
+// --worker: traces tiles for a --farm coordinator until it says to stop. Keeps trying to connect
+// for a minute, so workers can be started before the coordinator.
+int runWorker(const std::string& address, const std::filesystem::path& restorePath)
+{
+    Socket socket;
+    std::string error;
+    for (int attempt = 0; attempt < 60 && !socket.valid(); ++attempt)
+    {
+        socket = Socket::connect(address, error);
+        if (!socket.valid())
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+    if (!socket.valid())
+    {
+        std::cerr << "[WORKER] " << error << '\n';
+        return EXIT_FAILURE;
+    }
+
+    const FarmHello hello;
+    uint32_t type = 0;
+    std::vector<std::byte> message;
+    FarmSetup setup{};
+    if (!socket.sendMessage(FARM_HELLO, std::as_bytes(std::span(&hello, 1))) || !socket.receiveMessage(type, message, 1 << 20) ||
+        type != FARM_SETUP || message.size() < sizeof(setup))
+    {
+        std::cerr << "[WORKER] No setup from " << address << '\n';
+        return EXIT_FAILURE;
+    }
+    std::memcpy(&setup, message.data(), sizeof(setup));
+    CameraPath path;
+    const std::string text(reinterpret_cast<const char*>(message.data()) + sizeof(setup), message.size() - sizeof(setup));
+    if (!path.parse(text, "farm path", error) || setup.tile <= 0)
+    {
+        std::cerr << "[WORKER] " << error << '\n';
+        return EXIT_FAILURE;
+    }
+    path.width = setup.width;
+    path.height = setup.height;
+
+    Engine engine(true);
+    if (!loadBodies(restorePath))
+        return EXIT_FAILURE;
+    if (sceneHash(objects) != setup.scene)
+    {
+        std::cerr << "[WORKER] Not the coordinator's scene: start the worker with the same --restore and geodesic.comp\n";
+        return EXIT_FAILURE;
+    }
+    engine.uploadDiskUBO();
+    PathReplay replay{.path = path};
+    Offscreen target;
+    if (!target.create(setup.tile, setup.tile))
+        return EXIT_FAILURE;
+    std::vector<uint8_t> pixels(size_t(setup.tile) * setup.tile * 4);
+    const float aspect = float(setup.width) / float(setup.height);
+    std::cout << std::format("[WORKER] Tracing for {}: {}x{} frames in tiles of {}\n", address, setup.traceWidth, setup.traceHeight, setup.tile);
+
+    uint64_t tiles = 0;
+    double busy = 0.0;
+    const auto start = std::chrono::steady_clock::now();
+    FarmTile tile;
+    while (socket.receiveMessage(type, message, sizeof(FarmTile)) && type == FARM_TILE && message.size() == sizeof(tile))
+    {
+        std::memcpy(&tile, message.data(), sizeof(tile));
+        if (tile.width <= 0 || tile.height <= 0 || tile.width > setup.tile || tile.height > setup.tile)
+        {
+            std::cerr << "[WORKER] Bad tile from " << address << '\n';
+            break;
+        }
+        const auto begin = std::chrono::steady_clock::now();
+        replay.seek(tile.frame, engine);
+        engine.traceRegion(path.cameraAt(tile.frame), aspect, target.color, tile.x, tile.y, tile.width, tile.height, setup.traceWidth, setup.traceHeight);
+        target.read(tile.width, tile.height, pixels.data());
+        const FarmResult result{tile.id, float(std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count())};
+        busy += result.seconds;
+        ++tiles;
+        if (!socket.sendMessage(FARM_RESULT, std::as_bytes(std::span(&result, 1)),
+                                std::as_bytes(std::span(pixels.data(), size_t(tile.width) * tile.height * 4))))
+            break;
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << std::format("[WORKER] {} tiles, busy {:.0f}% of {:.1f} s\n", tiles, seconds > 0.0 ? busy / seconds * 100.0 : 0.0, seconds);
+    target.destroy();
+    engine.destroyHeadlessContext();
+    return 0;
+}
+
+// --farm: where to listen, and how to split frames
+struct FarmSpec
+{
+    std::string listen = "127.0.0.1:7700"; // "0.0.0.0:7700" for workers on other machines
+    int localWorkers = 0;                  // started here as --worker processes
+    int tile = 128;                        // tile edge in traced pixels
+};
+
+// Starts this program as a --worker in the background; 0 if it could not be
+intptr_t spawnWorker(const char* program, const std::string& address, const std::filesystem::path& restorePath)
+{
+    std::vector<std::string> args = {program, "--worker", address};
+    if (!restorePath.empty())
+    {
+        args.push_back("--restore");
+        args.push_back(restorePath.string());
+    }
+    std::vector<char*> argv;
+    for (std::string& arg : args)
+        argv.push_back(arg.data());
+    argv.push_back(nullptr);
+#ifdef _WIN32
+    const intptr_t process = _spawnv(_P_NOWAIT, program, argv.data());
+    return process == -1 ? 0 : process;
+#else
+    pid_t pid;
+    return posix_spawnp(&pid, program, nullptr, nullptr, argv.data(), environ) == 0 ? pid : 0;
+#endif
+}
+
+// --farm: a camera path rendered like --animate, with each frame split into tiles that --worker
+// processes trace, here or on other machines. Workers may join or drop out at any time: a lost
+// worker's tiles are traced again by the others, and stragglers are duplicated (FarmScheduler).
+// Finished frames are encoded and written on the job system, and resume like --animate's.
+int runFarm(const std::filesystem::path& pathFile, const std::filesystem::path& dir, const int* size, const FarmSpec& spec,
+            const char* program, const std::filesystem::path& restorePath)
+{
+    CameraPath path;
+    std::string text, error;
+    if (!path.load(pathFile, text, error))
+    {
+        std::cerr << error << '\n';
+        return EXIT_FAILURE;
+    }
+    if (size)
+    {
+        path.width = size[0];
+        path.height = size[1];
+    }
+    if (path.aovs)
+    {
+        std::cout << "[FARM] AOVs are not farmed; writing color only\n";
+        path.aovs = false;
+    }
+    // The workers trace; the bodies are loaded here for the scene hash alone
+    if (!loadBodies(restorePath))
+        return EXIT_FAILURE;
+    const uint64_t scene = sceneHash(objects);
+    std::filesystem::create_directories(dir);
+    const AnimationProgress progress{dir, path.key(scene)};
+    const int frames = path.frameCount();
+    const int first = progress.load(frames);
+    const int traceWidth = path.width * path.supersample, traceHeight = path.height * path.supersample;
+    const int tile = std::max(16, spec.tile);
+    const int columns = (traceWidth + tile - 1) / tile, rows = (traceHeight + tile - 1) / tile;
+
+    Socket listener = Socket::listen(spec.listen, error);
+    if (!listener.valid())
+    {
+        std::cerr << "[FARM] " << error << '\n';
+        return EXIT_FAILURE;
+    }
+    std::string host, port;
+    Socket::splitAddress(spec.listen, host, port);
+    const std::string local = (host == "0.0.0.0" || host == "::" ? "127.0.0.1" : host) + ":" + port;
+    std::vector<intptr_t> children;
+    for (int i = 0; i < spec.localWorkers; ++i)
+        if (const intptr_t child = spawnWorker(program, local, restorePath))
+            children.push_back(child);
+
+    std::vector<std::byte> setup(sizeof(FarmSetup) + text.size());
+    const FarmSetup head{path.width, path.height, traceWidth, traceHeight, tile, scene};
+    std::memcpy(setup.data(), &head, sizeof(head));
+    std::memcpy(setup.data() + sizeof(head), text.data(), text.size());
+
+    struct Worker
+    {
+        Socket socket;
+        MessageReader reader{};
+        bool ready = false;           // sent its hello
+        std::vector<uint32_t> held{}; // tiles in flight,
+        std::vector<double> sentAt{}; // and when each was sent
+        uint64_t tiles = 0;
+        double pixels = 0.0, busy = 0.0;
+        double joined = 0.0, left = -1.0;
+    };
+    constexpr size_t DEPTH = 2; // tiles in flight per worker, so none waits on a round trip
+    std::vector<Worker> workers;
+    FarmScheduler scheduler;
+
+    constexpr size_t SLOTS = 4; // frames assembled or encoding at once
+    std::array<AnimationFrame, SLOTS> slots;
+    std::array<int, SLOTS> remaining{}; // tiles still to come
+    for (AnimationFrame& slot : slots)
+        slot.allocate(path);
+    std::vector<uint8_t> finished(frames, 0);
+    std::fill(finished.begin(), finished.begin() + first, uint8_t(1));
+
+    std::cout << std::format("[FARM] {} frames of {}x{} ({}x supersampled) in {} tiles each, listening on {}{}\n", frames, path.width,
+                             path.height, path.supersample, columns * rows, spec.listen,
+                             first ? std::format(", resuming at frame {}", first) : "");
+
+    int saved = first, written = 0, nextFrame = first;
+    size_t bytes = 0;
+    double encodeSeconds = 0.0;
+    bool ok = true;
+    auto finish = [&](AnimationFrame& slot)
+    {
+        pool.wait(slot.counter);
+        if (!slot.ok)
+        {
+            std::cerr << "\n[ERROR] Could not write " << slot.path.string() << '\n';
+            ok = false;
+        }
+        else if (ok)
+        {
+            // Frames finish out of order; progress covers the ones before the first missing
+            finished[slot.frame] = 1;
+            ++written;
+            bytes += slot.bytes;
+            encodeSeconds += slot.seconds;
+            const int before = saved;
+            while (saved < frames && finished[saved])
+                ++saved;
+            if (saved != before)
+                progress.save(saved);
+        }
+        slot.frame = -1;
+    };
+
+    const auto start = std::chrono::steady_clock::now();
+    auto clock = [&] { return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); };
+    auto drop = [&](Worker& w, size_t index, const char* why)
+    {
+        for (uint32_t id : w.held)
+            scheduler.lost(id);
+        std::cout << std::format("\n[FARM] Worker {} {}, {} tiles requeued\n", index, why, w.held.size());
+        w.held.clear();
+        w.sentAt.clear();
+        w.socket.close();
+        w.left = clock();
+    };
+
+    std::vector<Socket*> sockets;
+    std::vector<size_t> socketWorker;
+    std::vector<uint8_t> readable;
+    std::vector<std::byte> message;
+    const size_t resultLimit = sizeof(FarmResult) + size_t(tile) * tile * 4;
+    double lastReport = 0.0;
+    bool waitingNoted = false;
+    while (ok && saved < frames)
+    {
+        // Admit frames in order while their slot is free
+        while (nextFrame < frames)
+        {
+            AnimationFrame& slot = slots[nextFrame % SLOTS];
+            if (slot.frame >= 0)
+            {
+                if (remaining[nextFrame % SLOTS] > 0)
+                    break;
+                finish(slot);
+            }
+            slot.frame = nextFrame;
+            slot.path = dir / std::format("frame-{:05}.qoi", nextFrame);
+            remaining[nextFrame % SLOTS] = columns * rows;
+            for (int y = 0; y < traceHeight; y += tile)
+                for (int x = 0; x < traceWidth; x += tile)
+                    scheduler.add(nextFrame, x, y, std::min(tile, traceWidth - x), std::min(tile, traceHeight - y));
+            ++nextFrame;
+        }
+        for (size_t i = 0; i < SLOTS; ++i)
+            if (slots[i].frame >= 0 && remaining[i] == 0 && slots[i].counter.done())
+                finish(slots[i]);
+
+        // Keep every worker DEPTH tiles ahead
+        const double now = clock();
+        size_t alive = 0;
+        for (size_t i = 0; i < workers.size(); ++i)
+        {
+            Worker& w = workers[i];
+            if (!w.socket.valid() || !w.ready)
+                continue;
+            ++alive;
+            FarmTile job;
+            while (w.held.size() < DEPTH && scheduler.next(now, w.held, job))
+            {
+                w.held.push_back(job.id);
+                w.sentAt.push_back(now);
+                if (!w.socket.sendMessage(FARM_TILE, std::as_bytes(std::span(&job, 1))))
+                {
+                    drop(w, i, "lost");
+                    break;
+                }
+            }
+        }
+        if (alive == 0 && !waitingNoted)
+            std::cout << "\n[FARM] Waiting for workers: black-hole --worker " << local << '\n';
+        waitingNoted = alive == 0;
+
+        // Results and new workers
+        sockets.assign(1, &listener);
+        socketWorker.assign(1, 0);
+        for (size_t i = 0; i < workers.size(); ++i)
+        {
+            if (workers[i].socket.valid())
+            {
+                sockets.push_back(&workers[i].socket);
+                socketWorker.push_back(i);
+            }
+        }
+        if (!Socket::waitReadable(sockets, 50, readable))
+            continue;
+        if (readable[0])
+        {
+            Socket client = listener.accept();
+            if (client.valid())
+            {
+                workers.push_back({.socket = std::move(client)});
+                workers.back().joined = clock();
+                std::cout << std::format("\n[FARM] Worker {} connected\n", workers.size() - 1);
+            }
+        }
+        for (size_t k = 1; k < sockets.size(); ++k)
+        {
+            if (!readable[k])
+                continue;
+            const size_t index = socketWorker[k];
+            Worker& w = workers[index];
+            if (!w.reader.receive(w.socket))
+            {
+                drop(w, index, "disconnected");
+                continue;
+            }
+            uint32_t type;
+            bool oversized = false;
+            while (w.socket.valid() && w.reader.next(type, message, resultLimit, oversized))
+            {
+                if (type == FARM_HELLO)
+                {
+                    const FarmHello expected;
+                    w.ready = message.size() == sizeof(expected) && std::memcmp(message.data(), expected.magic, sizeof(expected.magic)) == 0;
+                    if (!w.ready || !w.socket.sendMessage(FARM_SETUP, setup))
+                        drop(w, index, "is not a worker of this version");
+                    continue;
+                }
+                FarmResult result{};
+                auto held = w.held.end();
+                if (type == FARM_RESULT && message.size() >= sizeof(result))
+                {
+                    std::memcpy(&result, message.data(), sizeof(result));
+                    held = std::find(w.held.begin(), w.held.end(), result.id);
+                }
+                if (held == w.held.end())
+                {
+                    drop(w, index, "sent an unexpected message");
+                    break;
+                }
+                const FarmTile& job = scheduler.tiles[result.id].job;
+                const size_t rowBytes = size_t(job.width) * 4;
+                if (message.size() != sizeof(result) + rowBytes * job.height)
+                {
+                    drop(w, index, "sent a short tile");
+                    break;
+                }
+                const size_t at = size_t(held - w.held.begin());
+                const double latency = clock() - w.sentAt[at];
+                w.held.erase(held);
+                w.sentAt.erase(w.sentAt.begin() + ptrdiff_t(at));
+                ++w.tiles;
+                w.pixels += double(job.width) * job.height;
+                w.busy += result.seconds;
+                if (!scheduler.complete(result.id, latency))
+                    continue;
+
+                // Rows bottom-up into the frame, at the tile's place
+                const size_t slotIndex = size_t(job.frame) % SLOTS;
+                AnimationFrame& slot = slots[slotIndex];
+                const std::byte* pixels = message.data() + sizeof(result);
+                for (int row = 0; row < job.height; ++row)
+                    std::memcpy(slot.rgba.data() + (size_t(job.y + row) * traceWidth + job.x) * 4, pixels + row * rowBytes, rowBytes);
+                if (--remaining[slotIndex] == 0)
+                    pool.run(slot.counter, slot);
+            }
+            if (oversized)
+                drop(w, index, "sent an oversized message");
+        }
+
+        if (clock() - lastReport >= 1.0)
+        {
+            lastReport = clock();
+            std::cout << std::format("\r[FARM] {} of {} frames, {} workers, {:.1f} tiles/s", saved, frames, alive,
+                                     lastReport > 0.0 ? double(scheduler.completed) / lastReport : 0.0)
+                      << std::flush;
+        }
+    }
+    for (size_t i = 0; i < SLOTS; ++i)
+        if (slots[i].frame >= 0 && remaining[i] == 0)
+            finish(slots[i]);
+
+    for (Worker& w : workers)
+        if (w.socket.valid())
+            w.socket.sendMessage(FARM_QUIT, {});
+    const double seconds = clock();
+    for (size_t i = 0; i < workers.size(); ++i)
+    {
+        const Worker& w = workers[i];
+        const double connected = (w.left < 0.0 ? seconds : w.left) - w.joined;
+        std::cout << std::format("[FARM] Worker {}: {} tiles, {:.1f} Mpixel, busy {:.0f}% of {:.1f} s{}\n", i, w.tiles, w.pixels * 1e-6,
+                                 connected > 0.0 ? w.busy / connected * 100.0 : 0.0, connected, w.left < 0.0 ? "" : ", lost");
+    }
+    workers.clear(); // closes the connections
+#ifndef _WIN32
+    for (intptr_t child : children)
+        waitpid(pid_t(child), nullptr, 0);
+#endif
+
+    std::cout << std::format("\n[FARM] {} frames in {:.1f} s: {:.2f} fps, {:.2f} Mpixel/s traced, {:.1f} ms per frame to encode, {:.1f} MB\n",
+                             written, seconds, seconds > 0.0 ? written / seconds : 0.0,
+                             seconds > 0.0 ? double(written) * traceWidth * traceHeight / seconds * 1e-6 : 0.0,
+                             written ? encodeSeconds / written * 1e3 : 0.0, bytes / 1e6);
+    std::cout << std::format("[FARM] {} tiles, mean latency {:.1f} ms; {} requeued from lost workers, {} duplicated, {} duplicates wasted\n",
+                             scheduler.completed, scheduler.meanLatency() * 1e3, scheduler.retries, scheduler.steals, scheduler.wasted);
+    return ok ? 0 : EXIT_FAILURE;
+}
+
+// --serve: where to listen, and how much to take on
+struct ServeSpec
+{
+    std::string listen = "127.0.0.1:7701";
+    size_t queue = 64;                 // requests waiting for the GPU; more are answered Busy
+    int perClient = 16;                // a client's requests in flight and replies unsent before its socket is left unread
+    int64_t maxPixels = 3840 * 2160;   // traced per request, quality included
+    size_t cacheMB = 256;              // frames kept in memory
+    size_t cacheDiskMB = 2048;         // and spilled into cacheDir, if given
+    std::filesystem::path cacheDir;
+};
+
+// One served request from readback to reply, resolved and QOI-encoded as a job, with its
+// lensing map as EXR after the frame if it asked for one
+struct ServeJob
+{
+    ServeQueue::Entry entry;
+    std::vector<uint8_t> rgba, rgb, encoded;
+    AovImage lensing; // empty unless asked for
+    std::vector<std::byte> exr;
+    size_t bytes = 0; // of the frame
+    double started = 0.0, rendered = 0.0; // batch traced from, and read back by, on the server clock
+    double encodeSeconds = 0.0;
+    JobCounter counter;
+
+    void operator()()
+    {
+        const auto start = std::chrono::steady_clock::now();
+        const ServeRequest& r = entry.request;
+        if (lensing.width > 0 && r.quality == 1)
+        {
+            // Traced once, the lensing trace's color being the frame (ServeBatch::colorFromLensing)
+            for (size_t i = 0; i < rgba.size(); ++i)
+                rgba[i] = uint8_t(std::clamp(lensing.data[i], 0.0f, 1.0f) * 255.0f + 0.5f);
+        }
+        resolveSupersampled(rgba.data(), r.quality, rgb.data(), r.width, r.height);
+        bytes = qoiEncode(rgb.data(), r.width, r.height, 3, encoded.data());
+        encoded.resize(bytes);
+        if (lensing.width > 0)
+        {
+            lensing.encodeExr(exr);
+            const auto* p = reinterpret_cast<const uint8_t*>(exr.data());
+            encoded.insert(encoded.end(), p, p + exr.size());
+        }
+        encodeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+
+// Requests traced together: the layers of one array texture, read back into one pixel buffer
+// behind one fence
+struct ServeBatch
+{
+    GLuint texture = 0, fbo = 0, pbo = 0;
+    int width = 0, height = 0;                          // traced, quality included
+    int allocWidth = 0, allocHeight = 0, allocLayers = 0; // what texture and pbo hold; only grows
+    GLsync fence = nullptr;
+    std::vector<ServeQueue::Entry> entries;
+    double started = 0.0;
+    bool colorFromLensing = false; // a lensing request at quality 1, traced only at the output size
+    AovTargets lensing; // a lensing request's AOVs at the output size, read back beside its frame
+    GLuint lensingPbo = 0;
+    int lensingWidth = 0, lensingHeight = 0;
+
+    size_t layerBytes() const
+    {
+        return size_t(width) * height * 4;
+    }
+
+    size_t lensingBytes() const
+    {
+        return size_t(lensingWidth) * lensingHeight * 4 * sizeof(float) * (1 + AOV_TARGETS);
+    }
+
+    // Traces w x h into the corner of the texture, which is reallocated only when a request
+    // needs more than it holds, so alternating sizes don't churn GPU memory
+    void reserve(int w, int h, int layers)
+    {
+        width = w;
+        height = h;
+        if (w <= allocWidth && h <= allocHeight && layers <= allocLayers)
+            return;
+        allocWidth = std::max(allocWidth, w);
+        allocHeight = std::max(allocHeight, h);
+        allocLayers = std::max(allocLayers, layers);
+        if (!texture)
+        {
+            glGenTextures(1, &texture);
+            glGenFramebuffers(1, &fbo);
+            glGenBuffers(1, &pbo);
+        }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, allocWidth, allocHeight, allocLayers, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, size_t(allocWidth) * allocHeight * 4 * allocLayers, nullptr, GL_STREAM_READ);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    void reserveLensing(int w, int h)
+    {
+        if (w == lensingWidth && h == lensingHeight)
+            return;
+        if (lensing.color)
+            lensing.destroy();
+        lensingWidth = w;
+        lensingHeight = h;
+        lensing.create(w, h);
+        if (!lensingPbo)
+            glGenBuffers(1, &lensingPbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, lensingPbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, lensingBytes(), nullptr, GL_STREAM_READ);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    // The first `layers` layers into the pixel buffer
+    void readBack(int layers)
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        for (int i = 0; i < layers; ++i)
+        {
+            glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture, 0, i);
+            glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, reinterpret_cast<void*>(i * layerBytes()));
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    }
+
+    void destroy()
+    {
+        if (fence)
+            glDeleteSync(fence);
+        glDeleteTextures(1, &texture);
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteBuffers(1, &pbo);
+        if (lensing.color)
+            lensing.destroy();
+        glDeleteBuffers(1, &lensingPbo);
+    }
+};
+
+// A frame the cache evicted, written to its spill directory on the I/O thread
+Task writeSpill(TaskScheduler& tasks, FrameCache& cache, FrameCache::Spill spill)
+{
+    const bool ok = co_await tasks.writeFile(spill.path, spill.file);
+    cache.spilled(spill, ok);
+}
+
+// A request whose frame was spilled, with the file as read back on the I/O thread
+struct SpillRead
+{
+    ServeQueue::Entry entry;
+    std::vector<std::byte> file{}; // empty if it could not be read
+};
+
+Task readSpill(TaskScheduler& tasks, std::filesystem::path path, ServeQueue::Entry entry, std::vector<SpillRead>& done)
+{
+    SpillRead read{.entry = entry};
+    if (!co_await tasks.readFile(std::move(path), read.file))
+        read.file.clear();
+    done.push_back(std::move(read));
+}
+
+volatile std::sig_atomic_t serveStop = 0;
+
+// --serve: renders the views clients ask for, headless, until interrupted. Requests from the same
+// radius and elevation at the same size are traced in one dispatch, up to Engine::MAX_LAYERS, and
+// two batches are in flight so the GPU traces one while the other is read back. Replies are
+// encoded on the job system. A full queue answers Busy at once, and a client with too many
+// requests in flight or replies unsent is not read until some finish, so TCP pushes back on it.
+// Replies go out without blocking as each client takes them, so a slow reader stalls no one else. Finished frames go
+// into a FrameCache, so a pose asked for again is answered with a copy instead of a trace; its
+// spills are written and read back on the TaskScheduler's I/O thread.
+int runServer(const ServeSpec& spec, const std::filesystem::path& restorePath)
+{
+    std::string error;
+    Socket listener = Socket::listen(spec.listen, error);
+    if (!listener.valid())
+    {
+        std::cerr << "[SERVE] " << error << '\n';
+        return EXIT_FAILURE;
+    }
+    Engine engine(true);
+    if (!loadBodies(restorePath))
+        return EXIT_FAILURE;
+    engine.uploadObjectsUBO(objects);
+    engine.uploadDiskUBO();
+    const uint64_t scene = sceneHash(objects);
+    // The largest traced edge: a texture's, and 16 pixels per work group the driver can dispatch
+    GLint maxTexture = 0, maxGroupsX = 0, maxGroupsY = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTexture);
+    glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 0, &maxGroupsX);
+    glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 1, &maxGroupsY);
+    const int64_t maxTracedWidth = std::min<int64_t>(maxTexture, int64_t(maxGroupsX) * 16);
+    const int64_t maxTracedHeight = std::min<int64_t>(maxTexture, int64_t(maxGroupsY) * 16);
+    FrameCache cache;
+    cache.memoryLimit = spec.cacheMB << 20;
+    cache.diskLimit = spec.cacheDiskMB << 20;
+    if (!spec.cacheDir.empty())
+        cache.open(spec.cacheDir);
+    std::signal(SIGINT, [](int) { serveStop = 1; });
+    std::signal(SIGTERM, [](int) { serveStop = 1; });
+    std::cout << std::format("[SERVE] Listening on {}, queue {}, batches of up to {}, cache {} MB", spec.listen, spec.queue, Engine::MAX_LAYERS, spec.cacheMB);
+    if (!spec.cacheDir.empty())
+        std::cout << std::format(" + {} MB in {} ({} frames there already)", spec.cacheDiskMB, spec.cacheDir.string(), cache.diskEntries());
+    std::cout << '\n';
+
+    struct Client
+    {
+        Socket socket;
+        MessageReader reader{};
+        MessageWriter writer{};
+        int inFlight = 0; // queued, tracing or encoding
+    };
+    std::vector<Client> clients;
+    ServeQueue queue;
+    queue.capacity = spec.queue;
+    std::array<ServeBatch, 2> batches;
+    std::vector<std::unique_ptr<ServeJob>> jobs, spare; // encoding, and done with for reuse
+    std::vector<SpillRead> spillReads;
+    TaskScheduler tasks; // after what its tasks touch
+    LatencySamples total, waiting, rendering, encoding;
+    uint64_t served = 0, busy = 0, invalid = 0, batchCount = 0, layerCount = 0, bytesSent = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+    auto clock = [&] { return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); };
+    auto reply = [&](size_t client, const ServeReply& r, std::span<const std::byte> image)
+    {
+        Client& c = clients[client];
+        if (!c.socket.valid())
+            return;
+        c.writer.queue(SERVE_REPLY, std::as_bytes(std::span(&r, 1)), image);
+        if (!c.writer.flush(c.socket))
+            c.socket.close();
+        bytesSent += image.size();
+    };
+    // Requests in flight and replies not yet taken both count against perClient
+    auto hasRoom = [&](const Client& c) { return c.inFlight + int(c.writer.queued()) < spec.perClient; };
+    // A request after its cache lookup: answered from the entry on a hit, else queued to trace
+    auto serveOrQueue = [&](const ServeQueue::Entry& e, const FrameCache::Entry* hit, FrameCache::Tier tier)
+    {
+        const ServeRequest& r = e.request;
+        if (hit)
+        {
+            const size_t size = (r.flags & SERVE_LENSING) ? hit->data.size() : hit->frameBytes;
+            reply(e.client, {r.id, ServeStatus::Ok, r.width, r.height, 0.0f, 0.0f, 0.0f, tier, uint32_t(hit->frameBytes)},
+                  std::as_bytes(std::span(hit->data.data(), size)));
+            total.add((clock() - e.received) * 1e3);
+            ++served;
+            return;
+        }
+        if (queue.full())
+        {
+            reply(e.client, {.id = r.id, .status = ServeStatus::Busy, .width = r.width, .height = r.height}, {});
+            ++busy;
+            return;
+        }
+        queue.entries.push_back(e);
+        ++clients[e.client].inFlight;
+    };
+    auto handle = [&](size_t index, uint32_t type, const std::vector<std::byte>& message)
+    {
+        ServeRequest r;
+        if (type != SERVE_REQUEST || message.size() != sizeof(r))
+        {
+            clients[index].socket.close();
+            return;
+        }
+        std::memcpy(&r, message.data(), sizeof(r));
+        const double received = clock();
+        const bool valid = r.width > 0 && r.height > 0 && r.quality >= 1 && r.quality <= 4 && std::isfinite(r.radius) && r.radius > 0.0f &&
+                           std::isfinite(r.azimuth) && std::isfinite(r.elevation) &&
+                           int64_t(r.width) * r.height * r.quality * r.quality <= spec.maxPixels &&
+                           int64_t(r.width) * r.quality <= maxTracedWidth && int64_t(r.height) * r.quality <= maxTracedHeight;
+        if (!valid)
+        {
+            reply(index, {.id = r.id, .status = ServeStatus::Invalid, .width = r.width, .height = r.height}, {});
+            ++invalid;
+            return;
+        }
+
+        const FrameKey key = FrameKey::quantize(r.radius, r.azimuth, r.elevation, r.width, r.height, r.quality, scene);
+        r.radius = key.radiusValue();
+        r.azimuth = key.azimuthValue();
+        r.elevation = key.elevationValue();
+        const ServeQueue::Entry entry{r, key, index, received};
+        FrameCache::Tier tier;
+        const FrameCache::Entry* hit = cache.find(key, (r.flags & SERVE_LENSING) != 0, tier);
+        if (tier == FrameCache::Tier::Disk)
+        {
+            tasks.spawn(readSpill(tasks, cache.spillPath(key), entry, spillReads));
+            ++clients[index].inFlight;
+            return;
+        }
+        serveOrQueue(entry, hit, tier);
+    };
+
+    std::vector<Socket*> sockets;
+    std::vector<size_t> socketClient;
+    std::vector<short> events, ready;
+    std::vector<std::byte> message;
+    std::vector<float> turns;
+    double lastReport = 0.0;
+    uint64_t servedAtReport = 0;
+    while (!serveStop)
+    {
+        // Batches read back: each request to an encode job
+        for (ServeBatch& batch : batches)
+        {
+            if (!batch.fence || glClientWaitSync(batch.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+                continue;
+            glDeleteSync(batch.fence);
+            batch.fence = nullptr;
+            const double now = clock();
+            const uint8_t* layers = nullptr;
+            if (!batch.colorFromLensing)
+            {
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, batch.pbo);
+                layers = static_cast<const uint8_t*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, batch.layerBytes() * batch.entries.size(), GL_MAP_READ_BIT));
+            }
+            for (size_t i = 0; i < batch.entries.size(); ++i)
+            {
+                if (spare.empty())
+                    spare.push_back(std::make_unique<ServeJob>());
+                std::unique_ptr<ServeJob> job = std::move(spare.back());
+                spare.pop_back();
+                const ServeRequest& r = batch.entries[i].request;
+                job->entry = batch.entries[i];
+                if (layers)
+                    job->rgba.assign(layers + i * batch.layerBytes(), layers + (i + 1) * batch.layerBytes());
+                else
+                    job->rgba.resize(size_t(r.width) * r.height * 4);
+                job->rgb.resize(size_t(r.width) * r.height * 3);
+                job->encoded.resize(qoiMaxSize(r.width, r.height, 3));
+                job->lensing.resize(0, 0);
+                if (r.flags & SERVE_LENSING)
+                {
+                    job->lensing.resize(r.width, r.height);
+                    glBindBuffer(GL_COPY_READ_BUFFER, batch.lensingPbo);
+                    std::memcpy(job->lensing.data.data(), glMapBufferRange(GL_COPY_READ_BUFFER, 0, batch.lensingBytes(), GL_MAP_READ_BIT), batch.lensingBytes());
+                    glUnmapBuffer(GL_COPY_READ_BUFFER);
+                }
+                job->started = batch.started;
+                job->rendered = now;
+                pool.run(job->counter, *job);
+                jobs.push_back(std::move(job));
+            }
+            if (layers)
+            {
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            }
+            batch.entries.clear();
+        }
+
+        // Encoded: replies
+        for (size_t i = 0; i < jobs.size();)
+        {
+            ServeJob& job = *jobs[i];
+            if (!job.counter.done())
+            {
+                ++i;
+                continue;
+            }
+            const ServeRequest& r = job.entry.request;
+            const ServeReply header{r.id, ServeStatus::Ok, r.width, r.height, float((job.started - job.entry.received) * 1e3),
+                                    float((job.rendered - job.started) * 1e3), float(job.encodeSeconds * 1e3), FrameCache::Tier::Miss, uint32_t(job.bytes)};
+            reply(job.entry.client, header, std::as_bytes(std::span(job.encoded)));
+            cache.insert({job.entry.key, std::move(job.encoded), job.bytes});
+            --clients[job.entry.client].inFlight;
+            waiting.add(header.queueMs);
+            rendering.add(header.renderMs);
+            encoding.add(header.encodeMs);
+            total.add((clock() - job.entry.received) * 1e3);
+            ++served;
+            spare.push_back(std::move(jobs[i]));
+            jobs[i] = std::move(jobs.back());
+            jobs.pop_back();
+        }
+
+        // Spilled frames read back: answered, or traced after all; then what the cache evicted
+        tasks.poll();
+        for (const SpillRead& read : spillReads)
+        {
+            const ServeQueue::Entry& e = read.entry;
+            --clients[e.client].inFlight;
+            serveOrQueue(e, cache.promote(e.key, (e.request.flags & SERVE_LENSING) != 0, read.file), FrameCache::Tier::Disk);
+        }
+        spillReads.clear();
+        for (FrameCache::Spill& spill : cache.spilling)
+            tasks.spawn(writeSpill(tasks, cache, std::move(spill)));
+        cache.spilling.clear();
+
+        // Requests already received, from clients with room
+        for (size_t i = 0; i < clients.size(); ++i)
+        {
+            Client& c = clients[i];
+            uint32_t type;
+            bool oversized = false;
+            while (c.socket.valid() && hasRoom(c) && c.reader.next(type, message, sizeof(ServeRequest), oversized))
+                handle(i, type, message);
+            if (oversized)
+                c.socket.close();
+        }
+
+        // Free batches: the oldest request and the ones that share its dispatch
+        for (ServeBatch& batch : batches)
+        {
+            if (batch.fence || queue.entries.empty())
+                continue;
+            queue.takeBatch(Engine::MAX_LAYERS, batch.entries);
+            const ServeRequest& first = batch.entries.front().request;
+            Camera camera;
+            camera.radius = first.radius;
+            camera.azimuth = first.azimuth;
+            camera.elevation = first.elevation;
+            const float aspect = float(first.width) / float(first.height);
+            batch.started = clock();
+            batch.colorFromLensing = (first.flags & SERVE_LENSING) && first.quality == 1;
+            if (!batch.colorFromLensing)
+            {
+                batch.reserve(first.width * first.quality, first.height * first.quality, int(batch.entries.size()));
+                turns.clear();
+                for (const ServeQueue::Entry& e : batch.entries)
+                    turns.push_back(e.request.azimuth - first.azimuth);
+                engine.traceLayers(camera, aspect, batch.texture, batch.width, batch.height, turns);
+                batch.readBack(int(batch.entries.size()));
+            }
+            if (first.flags & SERVE_LENSING)
+            {
+                // Alone in its batch (ServeQueue::batchable); above quality 1 the frame is traced
+                // supersampled on its own
+                batch.reserveLensing(first.width, first.height);
+                engine.traceRegion(camera, aspect, batch.lensing.color, 0, 0, first.width, first.height, first.width, first.height, batch.lensing.aovs.data());
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, batch.lensingPbo);
+                batch.lensing.read(first.width, first.height, nullptr);
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            }
+            batch.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            ++batchCount;
+            layerCount += batch.entries.size();
+        }
+
+        // New clients, requests, and room for replies; polled quickly while the GPU or the
+        // encoder has work
+        sockets.assign(1, &listener);
+        socketClient.assign(1, 0);
+        events.assign(1, POLLIN);
+        for (size_t i = 0; i < clients.size(); ++i)
+        {
+            const Client& c = clients[i];
+            const short want = short((hasRoom(c) ? POLLIN : 0) | (c.writer.pending() ? POLLOUT : 0));
+            if (c.socket.valid() && want)
+            {
+                sockets.push_back(&clients[i].socket);
+                socketClient.push_back(i);
+                events.push_back(want);
+            }
+        }
+        const bool working = !jobs.empty() || batches[0].fence || batches[1].fence || tasks.counts().tasks > 0;
+        if (Socket::waitReady(sockets, events, working ? 1 : 50, ready))
+        {
+            if (ready[0] & POLLIN)
+            {
+                Socket socket = listener.accept();
+                if (socket.valid())
+                {
+                    socket.setNonBlocking();
+                    auto it = std::find_if(clients.begin(), clients.end(), [](const Client& c) { return !c.socket.valid() && c.inFlight == 0; });
+                    if (it == clients.end())
+                        it = clients.insert(clients.end(), Client{});
+                    *it = Client{.socket = std::move(socket)};
+                }
+            }
+            for (size_t k = 1; k < sockets.size(); ++k)
+            {
+                Client& c = clients[socketClient[k]];
+                if ((ready[k] & events[k] & POLLOUT) && !c.writer.flush(c.socket))
+                    c.socket.close();
+                if (c.socket.valid() && (ready[k] & events[k] & POLLIN) && !c.reader.receive(c.socket))
+                    c.socket.close(); // its requests in flight are traced, and the replies dropped
+            }
+        }
+
+        if (clock() - lastReport >= 5.0)
+        {
+            const double now = clock();
+            if (served != servedAtReport)
+                std::cout << std::format("[SERVE] {:.1f} req/s, {:.2f} per batch, {} queued, {} busy, {} invalid | total p50 {:.1f} p90 {:.1f} p99 {:.1f} ms "
+                                         "| queue p50 {:.1f} render p50 {:.1f} encode p50 {:.1f} ms | cache {:.0f}% hits, {:.0f} MB\n",
+                                         double(served - servedAtReport) / (now - lastReport), batchCount ? double(layerCount) / batchCount : 0.0,
+                                         queue.entries.size(), busy, invalid, total.percentile(0.5), total.percentile(0.9), total.percentile(0.99),
+                                         waiting.percentile(0.5), rendering.percentile(0.5), encoding.percentile(0.5), cache.hitRatio() * 100.0,
+                                         cache.memoryBytes / 1e6);
+            lastReport = now;
+            servedAtReport = served;
+        }
+    }
+
+    for (auto& job : jobs)
+        pool.wait(job->counter);
+    while (tasks.counts().tasks > 0) // spills still being written
+    {
+        tasks.poll();
+        std::this_thread::yield();
+    }
+    const double seconds = clock();
+    std::cout << std::format("\n[SERVE] {} requests in {:.1f} s ({:.1f} req/s), {} batches ({:.2f} per batch), {} busy, {} invalid, {:.1f} MB sent\n",
+                             served, seconds, seconds > 0.0 ? served / seconds : 0.0, batchCount, batchCount ? double(layerCount) / batchCount : 0.0,
+                             busy, invalid, bytesSent / 1e6);
+    std::cout << std::format("[SERVE] Latency p50/p90/p99: total {:.1f}/{:.1f}/{:.1f} ms, queue {:.1f}/{:.1f}/{:.1f}, render {:.1f}/{:.1f}/{:.1f}, encode {:.1f}/{:.1f}/{:.1f}\n",
+                             total.percentile(0.5), total.percentile(0.9), total.percentile(0.99), waiting.percentile(0.5), waiting.percentile(0.9),
+                             waiting.percentile(0.99), rendering.percentile(0.5), rendering.percentile(0.9), rendering.percentile(0.99),
+                             encoding.percentile(0.5), encoding.percentile(0.9), encoding.percentile(0.99));
+    std::cout << std::format("[SERVE] Cache: {:.1f}% hits ({} from memory, {} from disk, {} misses), {} frames in {:.1f} MB of memory, "
+                             "{} in {:.1f} MB on disk, {} spilled, {} dropped\n",
+                             cache.hitRatio() * 100.0, cache.memoryHits, cache.diskHits, cache.misses, cache.memoryEntries(), cache.memoryBytes / 1e6,
+                             cache.diskEntries(), cache.diskBytes / 1e6, cache.spills, cache.drops);
+    for (ServeBatch& batch : batches)
+        batch.destroy();
+    engine.destroyHeadlessContext();
+    return 0;
+}
+
+// --fetch: asks a --serve for `frames` views around one orbit at once, at the headless camera's
+// radius and elevation, and saves the frames (and lensing maps, with --lensing) into --output if
+// given. For testing a server and measuring it from the client side.
+int runFetch(const std::string& address, const HeadlessSpec& spec, int quality, bool lensing)
+{
+    std::string error;
+    Socket socket = Socket::connect(address, error);
+    if (!socket.valid())
+    {
+        std::cerr << "[FETCH] " << error << '\n';
+        return EXIT_FAILURE;
+    }
+    if (!spec.output.empty())
+        std::filesystem::create_directories(spec.output);
+
+    const int count = std::max(1, spec.frames);
+    const auto start = std::chrono::steady_clock::now();
+    auto clock = [&] { return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); };
+    std::vector<double> sent(count);
+    for (int i = 0; i < count; ++i)
+    {
+        const ServeRequest r{uint32_t(i), spec.radius, spec.azimuth + 2.0f * PI * float(i) / float(count), spec.elevation,
+                             spec.width, spec.height, quality, lensing ? SERVE_LENSING : 0u};
+        sent[i] = clock();
+        if (!socket.sendMessage(SERVE_REQUEST, std::as_bytes(std::span(&r, 1))))
+        {
+            std::cerr << "[FETCH] Lost " << address << '\n';
+            return EXIT_FAILURE;
+        }
+    }
+
+    LatencySamples latency;
+    std::array<int, 3> statuses{}, tiers{};
+    const size_t limit = sizeof(ServeReply) + qoiMaxSize(spec.width, spec.height, 3) +
+                         (lensing ? size_t(spec.height) * (16 + size_t(spec.width) * 4 * sizeof(float) * (1 + AOV_TARGETS)) + 4096 : 0);
+    double queueMs = 0.0, renderMs = 0.0, encodeMs = 0.0;
+    size_t bytes = 0;
+    uint32_t type;
+    std::vector<std::byte> message;
+    ServeReply r;
+    for (int received = 0; received < count; ++received)
+    {
+        if (!socket.receiveMessage(type, message, limit) || type != SERVE_REPLY || message.size() < sizeof(r))
+        {
+            std::cerr << "[FETCH] Lost " << address << " after " << received << " replies\n";
+            return EXIT_FAILURE;
+        }
+        std::memcpy(&r, message.data(), sizeof(r));
+        if (r.id >= uint32_t(count))
+            continue;
+        latency.add((clock() - sent[r.id]) * 1e3);
+        ++statuses[std::clamp(int(r.status), 0, 2)];
+        if (r.status != ServeStatus::Ok || r.frameBytes > message.size() - sizeof(r))
+            continue;
+        ++tiers[std::clamp(int(r.cache), 0, 2)];
+        queueMs += r.queueMs;
+        renderMs += r.renderMs;
+        encodeMs += r.encodeMs;
+        bytes += message.size() - sizeof(r);
+        if (!spec.output.empty())
+        {
+            const char* data = reinterpret_cast<const char*>(message.data() + sizeof(r));
+            std::ofstream(spec.output / std::format("fetch-{:03}.qoi", r.id), std::ios::binary | std::ios::trunc).write(data, r.frameBytes);
+            if (message.size() - sizeof(r) > r.frameBytes)
+                std::ofstream(spec.output / std::format("fetch-{:03}.exr", r.id), std::ios::binary | std::ios::trunc)
+                    .write(data + r.frameBytes, std::streamsize(message.size() - sizeof(r) - r.frameBytes));
+        }
+    }
+
+    const double seconds = clock();
+    std::cout << std::format("[FETCH] {} frames of {}x{} in {:.2f} s ({:.1f} fps), {} busy, {} invalid, {:.1f} MB; {} cached ({} in memory, {} on disk)\n",
+                             statuses[0], spec.width, spec.height, seconds, seconds > 0.0 ? statuses[0] / seconds : 0.0, statuses[1], statuses[2],
+                             bytes / 1e6, tiers[1] + tiers[2], tiers[1], tiers[2]);
+    const int rendered = std::max(1, tiers[0]);
+    std::cout << std::format("[FETCH] Latency p50 {:.1f} p90 {:.1f} p99 {:.1f} ms; server mean queue {:.1f}, render {:.1f}, encode {:.1f} ms when rendered\n",
+                             latency.percentile(0.5), latency.percentile(0.9), latency.percentile(0.99), queueMs / rendered, renderMs / rendered,
+                             encodeMs / rendered);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    std::filesystem::path restorePath, checkpointPath, generatePath;
+    Scene scene = Scene::Disk;
+    size_t tracerCount = NUM_TRACERS;
+    uint64_t seed = 42;
+    Pacing pacing = Pacing::VSync;
+    double targetFps = 60.0;
+    std::string recordPath;
+    int recordFps = 60;
+    PosterSpec poster;
+    bool posterAtStart = false;
+    bool headless = false;
+    HeadlessSpec headlessSpec;
+    bool sizeGiven = false;
+    std::filesystem::path animatePath, farmPath;
+    FarmSpec farm;
+    std::string workerAddress;
+    bool serve = false;
+    ServeSpec serveSpec;
+    std::string fetchAddress;
+    int quality = 1;
+    bool lensing = false;
+    auto invalid = [](std::string_view arg, std::string_view value, std::string_view expected = {})
+    {
+        std::cerr << "Invalid value for " << arg << ": " << value;
+        if (!expected.empty())
+            std::cerr << " (expected " << expected << ')';
+        std::cerr << '\n';
+        return EXIT_FAILURE;
+    };
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string_view arg = argv[i];
+        if (arg == "--bench-grid")
+            return benchGrid();
+        if (arg == "--restore" && i + 1 < argc)
+            restorePath = argv[++i];
+        else if (arg == "--checkpoint" && i + 1 < argc)
+            checkpointPath = argv[++i];
+        else if (arg == "--generate" && i + 1 < argc)
+            generatePath = argv[++i];
+        else if (arg == "--tracers" && i + 1 < argc)
+        {
+            if (!parseNumber(argv[++i], tracerCount))
+                return invalid(arg, argv[i]);
+        }
+        else if (arg == "--seed" && i + 1 < argc)
+        {
+            if (!parseNumber(argv[++i], seed))
+                return invalid(arg, argv[i]);
+        }
+        else if (arg == "--scene" && i + 1 < argc)
+        {
+            const std::string_view name = argv[++i];
+            if (name == "disk")
+                scene = Scene::Disk;
+            else if (name == "plummer")
+                scene = Scene::Plummer;
+            else if (name == "ring")
+                scene = Scene::Ring;
+            else
+                return invalid(arg, name, "disk, plummer or ring");
+        }
+        else if (arg == "--record" && i + 1 < argc)
+            recordPath = argv[++i];
+        else if (arg == "--record-fps" && i + 1 < argc)
+        {
+            if (!parseNumber(argv[++i], recordFps))
+                return invalid(arg, argv[i]);
+            recordFps = std::max(1, recordFps);
+        }
+        else if (arg == "--poster" && i + 1 < argc)
+        {
+            if (!parseSize(argv[++i], poster.width, poster.height))
+                return invalid(arg, argv[i]);
+            posterAtStart = true; // started with the window, resumed if it can be
+        }
+        else if (arg == "--headless")
+            headless = true;
+        else if (arg == "--animate" && i + 1 < argc)
+            animatePath = argv[++i];
+        else if (arg == "--farm" && i + 1 < argc)
+            farmPath = argv[++i];
+        else if (arg == "--listen" && i + 1 < argc)
+            farm.listen = serveSpec.listen = argv[++i];
+        else if (arg == "--serve")
+            serve = true;
+        else if (arg == "--queue" && i + 1 < argc)
+        {
+            if (!parseNumber(argv[++i], serveSpec.queue) || serveSpec.queue < 1)
+                return invalid(arg, argv[i], "a request count of at least 1");
+        }
+        else if (arg == "--fetch" && i + 1 < argc)
+            fetchAddress = argv[++i];
+        else if (arg == "--quality" && i + 1 < argc)
+        {
+            if (!parseNumber(argv[++i], quality) || quality < 1 || quality > 4)
+                return invalid(arg, argv[i], "1 to 4");
+        }
+        else if (arg == "--lensing")
+            lensing = true;
+        else if ((arg == "--cache-mb" || arg == "--cache-disk-mb") && i + 1 < argc)
+        {
+            size_t& mb = arg == "--cache-mb" ? serveSpec.cacheMB : serveSpec.cacheDiskMB;
+            if (!parseNumber(argv[++i], mb) || mb > (SIZE_MAX >> 20))
+                return invalid(arg, argv[i], "megabytes");
+        }
+        else if (arg == "--cache-dir" && i + 1 < argc)
+            serveSpec.cacheDir = argv[++i];
+        else if (arg == "--workers" && i + 1 < argc)
+        {
+            if (!parseNumber(argv[++i], farm.localWorkers) || farm.localWorkers < 0)
+                return invalid(arg, argv[i], "a worker count");
+        }
+        else if (arg == "--tile" && i + 1 < argc)
+        {
+            if (!parseNumber(argv[++i], farm.tile) || farm.tile <= 0)
+                return invalid(arg, argv[i], "a tile edge in pixels");
+        }
+        else if (arg == "--worker" && i + 1 < argc)
+            workerAddress = argv[++i];
+        else if (arg == "--size" && i + 1 < argc)
+        {
+            if (!parseSize(argv[++i], headlessSpec.width, headlessSpec.height))
+                return invalid(arg, argv[i]);
+            sizeGiven = true;
+        }
+        else if (arg == "--frames" && i + 1 < argc)
+        {
+            if (!parseNumber(argv[++i], headlessSpec.frames) || headlessSpec.frames < 0)
+                return invalid(arg, argv[i], "a frame count");
+        }
+        else if (arg == "--output" && i + 1 < argc)
+            headlessSpec.output = argv[++i];
+        else if (arg == "--aov")
+            headlessSpec.aovs = true;
+        else if (arg == "--camera" && i + 1 < argc)
+        {
+            // radius,azimuth,elevation in meters and radians
+            const std::string_view spec = argv[++i];
+            if (std::sscanf(std::string(spec).c_str(), "%f,%f,%f", &headlessSpec.radius, &headlessSpec.azimuth, &headlessSpec.elevation) != 3)
+                return invalid(arg, spec, "radius,azimuth,elevation");
+        }
+        else if (arg == "--poster-out" && i + 1 < argc)
+            poster.path = argv[++i];
+        else if (arg == "--pacing" && i + 1 < argc)
+        {
+            // vsync, eco, unlimited, or a target frame rate
+            const std::string_view name = argv[++i];
+            if (name == "eco")
+                pacing = Pacing::Eco;
+            else if (name == "unlimited")
+                pacing = Pacing::Unlimited;
+            else if (name != "vsync")
+            {
+                pacing = Pacing::Target;
+                if (!parseNumber(name, targetFps))
+                    return invalid(arg, name);
+                targetFps = std::max(1.0, targetFps);
+            }
+        }
+    }
+
+    // --generate: write the initial scene as a snapshot for --restore, without opening a window
+    if (!generatePath.empty())
+    {
+        const auto start = std::chrono::steady_clock::now();
+        addObjects(objects, sceneObjects);
+        seedTracers(tracers, tracerCount, scene, seed);
+        sortTracers(tracers);
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (!writeSnapshot(generatePath, 0, snapshotColumns(objects, tracers)))
+        {
+            std::cerr << "Failed to write snapshot: " << generatePath.string() << '\n';
+            return EXIT_FAILURE;
+        }
+        std::cout << std::format("[INFO] Generated {} tracers in {:.2f} s on {} threads -> {}\n", tracers.size(), seconds,
+                                 pool.size(), generatePath.string());
+        return 0;
+    }
+
+    if (!workerAddress.empty())
+        return runWorker(workerAddress, restorePath);
+    if (serve)
+        return runServer(serveSpec, restorePath);
+    if (!fetchAddress.empty())
+        return runFetch(fetchAddress, headlessSpec, quality, lensing);
+    if (!farmPath.empty())
+    {
+        const int size[2] = {headlessSpec.width, headlessSpec.height};
+        return runFarm(farmPath, headlessSpec.output.empty() ? "frames" : headlessSpec.output, sizeGiven ? size : nullptr, farm, argv[0], restorePath);
+    }
+    if (!animatePath.empty())
+    {
+        const int size[2] = {headlessSpec.width, headlessSpec.height};
+        return runAnimation(animatePath, headlessSpec.output.empty() ? "frames" : headlessSpec.output, sizeGiven ? size : nullptr, headlessSpec.aovs, restorePath);
+    }
+    if (headless)
+        return runHeadless(headlessSpec, restorePath);
+
+    Engine engine;
+    Camera camera;
+    RenderOptions options;
+    options.pacing = pacing;
+    FramePacer pacer;
+    pacer.targetFps = targetFps;
+    pacer.init(pacing);
+    TaskScheduler tasks;
+    int screenshots = 0;
+    int aovShots = 0;
+    VideoCapture video;
+    int recordings = 0;
+    bool posterRunning = false;
+    Simulation sim;
+    InputRouting input;
+    input.simulation = &sim.input;
+    setupInputCallbacks(engine.window, input);
+
+    uint64_t gravitySteps = 0;
+    if (!restorePath.empty())
+    {
+        const auto start = std::chrono::steady_clock::now();
+        if (!restoreSnapshot(restorePath, objects, tracers, gravitySteps))
+        {
+            std::cerr << "Failed to restore snapshot: " << restorePath.string() << '\n';
+            exit(EXIT_FAILURE);
+        }
+        std::cout << std::format("[INFO] Restored step {} from {} in {:.1f} ms\n", gravitySteps, restorePath.string(),
+                                 std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1e3);
+    }
+    else
+    {
+        addObjects(objects, sceneObjects);
+        seedTracers(tracers, tracerCount, scene, seed);
+        sortTracers(tracers);
+    }
+
+    std::unique_ptr<CheckpointWriter> checkpoint;
+    if (!checkpointPath.empty())
+        checkpoint = std::make_unique<CheckpointWriter>(checkpointPath);
+    std::cout << "[INFO] " << objects.size() << " massive bodies, " << tracers.size() << " tracers\n";
+
+    // From here on the simulation thread owns `objects` and `tracers`
+    sim.start(gravitySteps, checkpoint.get());
+
+    double lastTime = glfwGetTime();
+    double lastPrintTime = lastTime;
+    int framesCount = 0;
+    FrameAllocCheck allocCheck;
+
+    // ---------- FRAME GRAPH ------------- //
+    FrameGraph graph;
+    const auto cameraView = graph.resource("camera");
+    const auto bodiesInput = graph.resource("bodies");
+    const auto tracersInput = graph.resource("tracers");
+    const auto fieldInput = graph.resource("potential");
+    const auto gridModeInput = graph.resource("grid mode");
+    const auto diskInput = graph.resource("disk params");
+    const auto windowInput = graph.resource("window size");
+    const auto tracerVBO = graph.resource("tracer VBO");
+    const auto objectsUBO = graph.resource("objects UBO");
+    const auto diskUBO = graph.resource("disk UBO");
+    const auto gridMesh = graph.resource("grid");
+    const auto tracedImage = graph.resource("traced image");
+    const auto backBuffer = graph.resource("back buffer");
+
+    const SimState* state = &sim.states.front();
+    GridWarp warp = GridWarp::None;
+
+    auto uploadTracers = [&] { engine.uploadTracers(state->x, state->y, state->z); };
+    auto uploadObjects = [&] { engine.uploadObjectsUBO(state->bodies); };
+    auto uploadDisk = [&] { engine.uploadDiskUBO(); };
+    auto buildGrid = [&]
+    {
+        const bool meshField = state->solver == Solver::ParticleMesh && state->potential.version != 0;
+        if (options.gridOnGpu)
+        {
+            // static clipmap, placed and displaced in grid.vert
+            if (meshField)
+                engine.uploadPotentialMap(state->potential);
+            warp = meshField ? GridWarp::Potential : GridWarp::Schwarzschild;
+        }
+        else
+        {
+            // rebuild grid mesh on CPU
+            engine.generateGrid(state->bodies, meshField ? &state->potential : nullptr);
+            warp = GridWarp::None;
+        }
+    };
+    // Late latch: pick up input that arrived while the frame was being built, right before the
+    // camera is uploaded and traced, instead of only at the top of the frame
+    LatencyStats latency;
+    CameraKey latched{};
+    auto latchCamera = [&]
+    {
+        {
+            AllocScope scope("poll events", true); // driver
+            glfwPollEvents();
+        }
+        drainRenderInput(input.render, camera, options, latency);
+        const CameraKey key = cameraKey(camera);
+        const bool moved = !(key == latched);
+        latched = key;
+        return moved;
+    };
+    auto traceImage = [&] { engine.dispatchCompute(camera); };
+    auto composite = [&]
+    {
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        // overlay the bent grid
+        mat4 view = glm::lookAt(camera.position(), camera.target, vec3(0, 1, 0));
+        mat4 proj = glm::perspective(glm::radians(60.0f), float(engine.COMPUTE_WIDTH) / engine.COMPUTE_HEIGHT, 1e9f, 1e14f);
+        mat4 viewProj = proj * view;
+        engine.drawGrid(viewProj, warp, camera);
+        engine.drawTracers(viewProj);
+
+        glViewport(0, 0, engine.WIDTH, engine.HEIGHT);
+        engine.drawFullScreenQuad();
+    };
+    graph.stage("tracers", {tracersInput}, {tracerVBO}, uploadTracers);
+    graph.stage("objects", {bodiesInput}, {objectsUBO}, uploadObjects);
+    graph.stage("disk", {diskInput}, {diskUBO}, uploadDisk);
+    graph.stage("grid", {bodiesInput, fieldInput, gridModeInput}, {gridMesh}, buildGrid);
+    graph.stage("camera", {}, {cameraView}, latchCamera, true);
+    graph.stage("trace", {cameraView, objectsUBO, diskUBO, windowInput}, {tracedImage}, traceImage);
+    graph.stage("composite", {cameraView, gridMesh, tracerVBO, tracedImage}, {backBuffer}, composite, true);
+
+    uint64_t tracersSeen = 0, bodiesSynced = 0;
+    constexpr double GRAPH_REPORT_INTERVAL = 5.0; // seconds
+    uint32_t lastRan = 0;
+    double lastGraphReport = -GRAPH_REPORT_INTERVAL;
+
+    if (!recordPath.empty())
+    {
+        glfwGetFramebufferSize(engine.window, &engine.WIDTH, &engine.HEIGHT);
+        video.start(recordPath, engine.WIDTH, engine.HEIGHT, recordFps);
+    }
+
+    bool idle = false; // the last frame changed nothing
+    while (!glfwWindowShouldClose(engine.window))
+    {
+        pacer.beginFrame(idle && !video.active(), tasks.counts().tasks > 0);
+        frameArena.reset();
+
+        double now = glfwGetTime();
+        lastTime = now;
+
+        drainRenderInput(input.render, camera, options, latency);
+        if (options.pacing != pacer.mode)
+        {
+            AllocScope scope("pacing report", true); // on request
+            pacer.print(pacer.mode);
+            pacer.setMode(options.pacing);
+            std::cout << "\n[INFO] Pacing: " << PACING_NAMES[static_cast<int>(pacer.mode)] << '\n';
+        }
+
+        // Tasks whose fences, jobs or file I/O completed since last frame; they run on request
+        // (screenshots, AOVs, posters) and allocate as they go
+        {
+            AllocScope scope("tasks", true);
+            tasks.poll();
+        }
+
+        // Latest complete simulation step
+        if (sim.states.update())
+        {
+            state = &sim.states.front();
+            if (state->bodies.changed(BODY_ALL, bodiesSynced))
+                graph.touch(bodiesInput);
+            bodiesSynced = state->bodies.synced();
+        }
+
+        // Update FPS and camera info
+        ++framesCount;
+        if (now - lastPrintTime >= 0.2)
+        {
+            double fps = framesCount / (now - lastPrintTime);
+            AllocScope scope("stats line");
+            const TaskScheduler::Counts pending = tasks.counts();
+            char line[320];
+            const auto out = std::format_to_n(line, sizeof(line), "\rFPS: {:.1f} ({}) | Radius: {:.2e} | Azimuth: {:.2f} | Elevation: {:.2f} | Grid: {:.3f} ms | Step: {:.1f} ms | Tasks: {} ({} gpu, {} cpu, {} io)",
+                                              fps, PACING_NAMES[static_cast<int>(pacer.mode)], camera.radius, camera.azimuth, camera.elevation, engine.gridSeconds * 1e3, state->stepSeconds * 1e3,
+                                              pending.tasks, pending.polling, pending.offloaded, pending.io);
+            std::cout.write(line, out.out - line);
+            framesCount = 0;
+            lastPrintTime = now;
+        }
+
+        // Inputs from outside the graph; stages whose inputs are unchanged are skipped
+        if (state->tracerVersion != tracersSeen)
+        {
+            graph.touch(tracersInput);
+            tracersSeen = state->tracerVersion;
+        }
+        graph.set(fieldInput, state->solver == Solver::ParticleMesh ? state->potential.version : 0u);
+        graph.set(gridModeInput, options.gridOnGpu);
+        int fbWidth = 0, fbHeight = 0;
+        glfwGetFramebufferSize(engine.window, &fbWidth, &fbHeight);
+        if (fbWidth > 0 && fbHeight > 0)
+        {
+            engine.WIDTH = fbWidth;
+            engine.HEIGHT = fbHeight;
+        }
+        graph.set(windowInput, std::array<int, 2>{engine.WIDTH, engine.HEIGHT});
+
+        engine.gridSeconds = 0.0;
+        pacer.beginGpu();
+        graph.execute();
+        idle = graph.quiet();
+
+        // What ran and why when that changes, at most every few seconds: with the sim and the
+        // display at different rates it changes nearly every frame
+        if (graph.ranMask() != lastRan && now - lastGraphReport >= GRAPH_REPORT_INTERVAL)
+        {
+            AllocScope scope("graph report");
+            char line[256];
+            const size_t length = graph.report(line, sizeof(line));
+            std::cout << "\n[GRAPH] ";
+            std::cout.write(line, length) << '\n';
+            lastRan = graph.ranMask();
+            lastGraphReport = now;
+        }
+
+        if (options.screenshot)
+        {
+            AllocScope scope("screenshot", true);
+            tasks.spawn(saveScreenshot(tasks, engine.WIDTH, engine.HEIGHT, std::format("screenshot-{:03}.ppm", screenshots++)));
+            options.screenshot = false;
+        }
+        if (options.aovs)
+        {
+            AllocScope scope("aovs", true);
+            tasks.spawn(saveAovs(tasks, engine, camera, engine.WIDTH, engine.HEIGHT, std::format("aov-{:03}.exr", aovShots++)));
+            options.aovs = false;
+        }
+        if (options.poster || std::exchange(posterAtStart, false))
+        {
+            AllocScope scope("poster", true);
+            if (posterRunning)
+                std::cout << "\n[POSTER] Already rendering " << poster.path.string() << '\n';
+            else
+                tasks.spawn(renderPoster(tasks, engine, poster, camera, posterRunning));
+            options.poster = false;
+        }
+        if (options.record)
+        {
+            AllocScope scope("start recording", true);
+            if (video.active())
+                video.stop();
+            else
+                video.start(recordPath.empty() ? std::format("capture-{:03}.y4m", recordings++) : recordPath, engine.WIDTH, engine.HEIGHT, recordFps);
+            options.record = false;
+        }
+        {
+            AllocScope scope("video capture", true); // driver
+            video.capture(now, engine.WIDTH, engine.HEIGHT);
+        }
+
+        // present to screen
+        {
+            AllocScope driverScope("present", true);
+            pacer.endGpu();
+            pacer.swap(engine.window);
+            latency.presented(glfwGetTime());
+            glfwPollEvents();
+        }
+        if (options.printLatency)
+        {
+            AllocScope scope("latency report", true); // on request
+            latency.print();
+            options.printLatency = false;
+        }
+        allocCheck.endFrame();
     }
 
+    sim.stop();
+    video.stop();
+    printJobStats(pool);
+    latency.print();
+    for (size_t m = 0; m < PACING_NAMES.size(); ++m)
+        pacer.print(static_cast<Pacing>(m));
     glfwDestroyWindow(engine.window);
     glfwTerminate();
     return 0;
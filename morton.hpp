@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+
+#include "parallel.hpp"
+
+// Spreads the low 10 bits of v so that two zero bits separate each of them
+inline uint32_t spreadBits(uint32_t v)
+{
+    v &= 0x3ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+// 30-bit Z-order key of a point quantised to 1024 cells per axis
+inline uint32_t mortonKey(float x, float y, float z, const std::array<float, 3>& lo, const std::array<float, 3>& scale)
+{
+    auto quantise = [](float v, float l, float s) { return static_cast<uint32_t>(std::clamp((v - l) * s, 0.0f, 1023.0f)); };
+    return spreadBits(quantise(x, lo[0], scale[0])) | (spreadBits(quantise(y, lo[1], scale[1])) << 1) | (spreadBits(quantise(z, lo[2], scale[2])) << 2);
+}
+
+// Orders a point set along a 3D Morton (Z-order) curve with a parallel LSD radix sort.
+// Scratch buffers are kept between sorts, so re-sorting a set of the same size does not allocate.
+struct MortonSorter
+{
+    std::vector<uint32_t> keys, keysTmp;
+    std::vector<uint32_t> order, orderTmp;
+    std::vector<std::array<uint32_t, 256>> histograms; // one per chunk
+    std::vector<std::array<float, 6>> bounds;          // per-chunk min xyz, max xyz
+
+    // Returns the new order: slot i receives the point that was at order[i]
+    const std::vector<uint32_t>& sort(JobSystem& pool, std::span<const float> x, std::span<const float> y, std::span<const float> z)
+    {
+        const size_t n = x.size();
+        const size_t chunks = std::max<size_t>(1, std::min(pool.size(), n));
+        keys.resize(n);
+        keysTmp.resize(n);
+        order.resize(n);
+        orderTmp.resize(n);
+        histograms.resize(chunks);
+        bounds.resize(chunks);
+
+        // 1) bounding box
+        constexpr float inf = std::numeric_limits<float>::infinity();
+        pool.parallelForChunks(n, chunks, [&](size_t c, size_t begin, size_t end)
+                               {
+                                   std::array<float, 6> b = {inf, inf, inf, -inf, -inf, -inf};
+                                   for (size_t i = begin; i < end; ++i)
+                                   {
+                                       b[0] = std::min(b[0], x[i]), b[3] = std::max(b[3], x[i]);
+                                       b[1] = std::min(b[1], y[i]), b[4] = std::max(b[4], y[i]);
+                                       b[2] = std::min(b[2], z[i]), b[5] = std::max(b[5], z[i]);
+                                   }
+                                   bounds[c] = b; });
+        std::array<float, 3> lo = {inf, inf, inf}, scale = {};
+        std::array<float, 3> hi = {-inf, -inf, -inf};
+        for (const auto& b : bounds)
+            for (int a = 0; a < 3; ++a)
+            {
+                lo[a] = std::min(lo[a], b[a]);
+                hi[a] = std::max(hi[a], b[a + 3]);
+            }
+        for (int a = 0; a < 3; ++a)
+            scale[a] = hi[a] > lo[a] ? 1023.0f / (hi[a] - lo[a]) : 0.0f;
+
+        // 2) keys
+        pool.parallelFor(n, [&](size_t begin, size_t end)
+                         {
+                             for (size_t i = begin; i < end; ++i)
+                             {
+                                 keys[i] = mortonKey(x[i], y[i], z[i], lo, scale);
+                                 order[i] = static_cast<uint32_t>(i);
+                             } });
+
+        // 3) stable LSD radix sort on 8-bit digits (30-bit keys, four passes)
+        for (int shift = 0; shift < 30; shift += 8)
+        {
+            pool.parallelForChunks(n, chunks, [&](size_t c, size_t begin, size_t end)
+                                   {
+                                       auto& h = histograms[c];
+                                       h.fill(0);
+                                       for (size_t i = begin; i < end; ++i)
+                                           ++h[(keys[i] >> shift) & 0xff]; });
+
+            // Digit-major, chunk-minor offsets keep equal digits in their original order
+            uint32_t sum = 0;
+            for (int d = 0; d < 256; ++d)
+                for (auto& h : histograms)
+                {
+                    const uint32_t count = h[d];
+                    h[d] = sum;
+                    sum += count;
+                }
+
+            pool.parallelForChunks(n, chunks, [&](size_t c, size_t begin, size_t end)
+                                   {
+                                       auto& h = histograms[c];
+                                       for (size_t i = begin; i < end; ++i)
+                                       {
+                                           const uint32_t dst = h[(keys[i] >> shift) & 0xff]++;
+                                           keysTmp[dst] = keys[i];
+                                           orderTmp[dst] = order[i];
+                                       } });
+            keys.swap(keysTmp);
+            order.swap(orderTmp);
+        }
+
+        return order;
+    }
+
+    // Applies the last sort to a column: column[i] = old column[order[i]]
+    template <typename T>
+    void permute(JobSystem& pool, std::vector<T>& column, std::vector<T>& scratch) const
+    {
+        scratch.resize(column.size());
+        pool.parallelFor(column.size(), [&](size_t begin, size_t end)
+                         {
+                             for (size_t i = begin; i < end; ++i)
+                                 scratch[i] = column[order[i]]; });
+        column.swap(scratch);
+    }
+};
@@ -0,0 +1,411 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+// TCP connections carrying length-prefixed messages: an 8-byte header (type, payload size), then
+// the payload, all in host byte order (little-endian on everything we build for). Addresses are
+// "host:port"; a bare port means 127.0.0.1, and "0.0.0.0:port" listens on every interface.
+struct MessageHeader
+{
+    uint32_t type;
+    uint32_t size;
+};
+
+struct Socket
+{
+#ifdef _WIN32
+    using Handle = SOCKET;
+    static constexpr Handle NONE = INVALID_SOCKET;
+#else
+    using Handle = int;
+    static constexpr Handle NONE = -1;
+#endif
+
+    Handle handle = NONE;
+
+    Socket() = default;
+    explicit Socket(Handle h)
+        : handle(h)
+    {
+    }
+    Socket(Socket&& other) noexcept
+        : handle(std::exchange(other.handle, NONE))
+    {
+    }
+    Socket& operator=(Socket&& other) noexcept
+    {
+        if (this != &other)
+        {
+            close();
+            handle = std::exchange(other.handle, NONE);
+        }
+        return *this;
+    }
+    ~Socket()
+    {
+        close();
+    }
+
+    bool valid() const
+    {
+        return handle != NONE;
+    }
+
+    void close()
+    {
+        if (handle == NONE)
+            return;
+#ifdef _WIN32
+        closesocket(handle);
+#else
+        ::close(handle);
+#endif
+        handle = NONE;
+    }
+
+    // Splits "host:port"; false if there is no port
+    static bool splitAddress(std::string_view address, std::string& host, std::string& port)
+    {
+        const size_t colon = address.rfind(':');
+        host = colon == std::string_view::npos ? "127.0.0.1" : std::string(address.substr(0, colon));
+        port = std::string(colon == std::string_view::npos ? address : address.substr(colon + 1));
+        if (host.empty())
+            host = "127.0.0.1";
+        return !port.empty();
+    }
+
+    static Socket listen(std::string_view address, std::string& error)
+    {
+        return open(address, true, error);
+    }
+
+    static Socket connect(std::string_view address, std::string& error)
+    {
+        return open(address, false, error);
+    }
+
+    // A waiting connection; call once the listening socket is readable
+    Socket accept()
+    {
+        Socket client(::accept(handle, nullptr, nullptr));
+        if (client.valid())
+            client.noDelay();
+        return client;
+    }
+
+    // Sends and receives return at once instead of waiting, for loops that serve many peers
+    void setNonBlocking()
+    {
+#ifdef _WIN32
+        u_long yes = 1;
+        ioctlsocket(handle, FIONBIO, &yes);
+#else
+        fcntl(handle, F_SETFL, fcntl(handle, F_GETFL) | O_NONBLOCK);
+#endif
+    }
+
+    // Whether the last failed call on a non-blocking socket only had to wait
+    static bool wouldBlock()
+    {
+#ifdef _WIN32
+        return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+    }
+
+    // What fits, at least one byte unless it failed (-1)
+    ptrdiff_t sendSome(const void* data, size_t size)
+    {
+#ifdef _WIN32
+        return ::send(handle, static_cast<const char*>(data), int(std::min<size_t>(size, 1 << 30)), 0);
+#elif defined(MSG_NOSIGNAL)
+        return ::send(handle, data, size, MSG_NOSIGNAL);
+#else
+        return ::send(handle, data, size, 0);
+#endif
+    }
+
+    bool sendAll(const void* data, size_t size)
+    {
+        const char* p = static_cast<const char*>(data);
+        while (size > 0)
+        {
+            const ptrdiff_t sent = sendSome(p, size);
+            if (sent <= 0)
+                return false;
+            p += sent;
+            size -= size_t(sent);
+        }
+        return true;
+    }
+
+    bool receiveAll(void* data, size_t size)
+    {
+        char* p = static_cast<char*>(data);
+        while (size > 0)
+        {
+            const ptrdiff_t got = receiveSome(p, size);
+            if (got <= 0)
+                return false;
+            p += got;
+            size -= size_t(got);
+        }
+        return true;
+    }
+
+    // What is there, at least one byte unless the peer closed (0) or it failed (-1)
+    ptrdiff_t receiveSome(void* data, size_t size)
+    {
+#ifdef _WIN32
+        return ::recv(handle, static_cast<char*>(data), int(std::min<size_t>(size, 1 << 30)), 0);
+#else
+        return ::recv(handle, data, size, 0);
+#endif
+    }
+
+    // The header and payload, the payload in up to two parts so a struct and its pixels need no copy
+    bool sendMessage(uint32_t type, std::span<const std::byte> head, std::span<const std::byte> tail = {})
+    {
+        const MessageHeader header{type, uint32_t(head.size() + tail.size())};
+        return sendAll(&header, sizeof(header)) && sendAll(head.data(), head.size()) && sendAll(tail.data(), tail.size());
+    }
+
+    // Blocks for the next message; false once closed, failed, or sent a payload over `limit`
+    bool receiveMessage(uint32_t& type, std::vector<std::byte>& payload, size_t limit)
+    {
+        MessageHeader header;
+        if (!receiveAll(&header, sizeof(header)) || header.size > limit)
+            return false;
+        type = header.type;
+        payload.resize(header.size);
+        return receiveAll(payload.data(), payload.size());
+    }
+
+    // Which of `sockets` can be read without blocking (data, a connection, or a hangup), waiting
+    // up to `timeoutMs`; false on error
+    static bool waitReadable(std::span<Socket* const> sockets, int timeoutMs, std::vector<uint8_t>& ready)
+    {
+        const std::vector<short> events(sockets.size(), POLLIN);
+        std::vector<short> revents;
+        const bool ok = waitReady(sockets, events, timeoutMs, revents);
+        ready.assign(sockets.size(), 0);
+        for (size_t i = 0; i < sockets.size(); ++i)
+            ready[i] = (revents[i] & POLLIN) != 0;
+        return ok;
+    }
+
+    // Waits up to `timeoutMs` for any of `sockets` to be ready for its `events` (POLLIN, POLLOUT,
+    // or both), and what each is ready for into `ready`, a hangup or error counting as both;
+    // false on error
+    static bool waitReady(std::span<Socket* const> sockets, std::span<const short> events, int timeoutMs, std::vector<short>& ready)
+    {
+#ifdef _WIN32
+        std::vector<WSAPOLLFD> fds(sockets.size());
+#else
+        std::vector<pollfd> fds(sockets.size());
+#endif
+        for (size_t i = 0; i < sockets.size(); ++i)
+            fds[i] = {sockets[i]->handle, events[i], 0};
+#ifdef _WIN32
+        const int result = WSAPoll(fds.data(), ULONG(fds.size()), timeoutMs);
+#else
+        const int result = ::poll(fds.data(), nfds_t(fds.size()), timeoutMs);
+#endif
+        ready.assign(sockets.size(), 0);
+        for (size_t i = 0; result > 0 && i < sockets.size(); ++i)
+            ready[i] = short(fds[i].revents & (POLLIN | POLLOUT)) | ((fds[i].revents & (POLLHUP | POLLERR)) ? short(POLLIN | POLLOUT) : short(0));
+        return result >= 0;
+    }
+
+private:
+    static Socket open(std::string_view address, bool server, std::string& error)
+    {
+#ifdef _WIN32
+        static const bool started = []
+        {
+            WSADATA data;
+            return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+        }();
+        if (!started)
+        {
+            error = "Winsock unavailable";
+            return {};
+        }
+#else
+        std::signal(SIGPIPE, SIG_IGN); // a dropped peer fails the send instead of killing us
+#endif
+        std::string host, port;
+        if (!splitAddress(address, host, port))
+        {
+            error = "no port in " + std::string(address);
+            return {};
+        }
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = server ? AI_PASSIVE : 0;
+        addrinfo* found = nullptr;
+        if (const int failed = getaddrinfo(host.c_str(), port.c_str(), &hints, &found))
+        {
+            error = std::string(address) + ": " + gai_strerror(failed);
+            return {};
+        }
+
+        Socket s;
+        for (addrinfo* a = found; a && !s.valid(); a = a->ai_next)
+        {
+            s = Socket(::socket(a->ai_family, a->ai_socktype, a->ai_protocol));
+            if (!s.valid())
+                continue;
+            bool ok;
+            if (server)
+            {
+                const int yes = 1;
+                setsockopt(s.handle, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&yes), sizeof(yes));
+                ok = ::bind(s.handle, a->ai_addr, int(a->ai_addrlen)) == 0 && ::listen(s.handle, 16) == 0;
+            }
+            else
+            {
+                ok = ::connect(s.handle, a->ai_addr, int(a->ai_addrlen)) == 0;
+                s.noDelay();
+            }
+            if (!ok)
+                s.close();
+        }
+        freeaddrinfo(found);
+        if (!s.valid())
+            error = std::string(server ? "cannot listen on " : "cannot connect to ") + std::string(address);
+        return s;
+    }
+
+    // Small messages (tile requests) go out at once instead of waiting to be coalesced
+    void noDelay()
+    {
+        const int yes = 1;
+        setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&yes), sizeof(yes));
+    }
+};
+
+// Reassembles messages from whatever a readable socket delivers, for loops that poll many
+struct MessageReader
+{
+    std::vector<std::byte> buffer;
+    size_t have = 0;
+
+    // One receive; false once the peer closed or failed
+    bool receive(Socket& socket)
+    {
+        if (buffer.size() - have < 64 * 1024)
+            buffer.resize(have + 256 * 1024);
+        const ptrdiff_t got = socket.receiveSome(buffer.data() + have, buffer.size() - have);
+        if (got < 0 && Socket::wouldBlock())
+            return true;
+        if (got <= 0)
+            return false;
+        have += size_t(got);
+        return true;
+    }
+
+    // The next complete message into `type` and `payload`; false if none is complete yet, or
+    // `oversized` set if one announced more than `limit` bytes
+    bool next(uint32_t& type, std::vector<std::byte>& payload, size_t limit, bool& oversized)
+    {
+        MessageHeader header;
+        if (have < sizeof(header))
+            return false;
+        std::memcpy(&header, buffer.data(), sizeof(header));
+        oversized = header.size > limit;
+        if (oversized || have < sizeof(header) + header.size)
+            return false;
+        type = header.type;
+        payload.assign(buffer.data() + sizeof(header), buffer.data() + sizeof(header) + header.size);
+        std::memmove(buffer.data(), buffer.data() + sizeof(header) + header.size, have - sizeof(header) - header.size);
+        have -= sizeof(header) + header.size;
+        return true;
+    }
+};
+
+// Messages waiting to go out on a non-blocking socket, sent as the peer takes them, so a slow
+// reader holds up only its own replies
+struct MessageWriter
+{
+    std::vector<std::byte> buffer;
+    size_t sent = 0;
+    std::deque<size_t> ends; // where each message not yet fully sent ends in `buffer`
+
+    // Messages queued and not yet fully sent
+    size_t queued() const
+    {
+        return ends.size();
+    }
+
+    bool pending() const
+    {
+        return sent < buffer.size();
+    }
+
+    // Like Socket::sendMessage; goes out with the next `flush`
+    void queue(uint32_t type, std::span<const std::byte> head, std::span<const std::byte> tail = {})
+    {
+        const MessageHeader header{type, uint32_t(head.size() + tail.size())};
+        const auto* h = reinterpret_cast<const std::byte*>(&header);
+        buffer.insert(buffer.end(), h, h + sizeof(header));
+        buffer.insert(buffer.end(), head.begin(), head.end());
+        buffer.insert(buffer.end(), tail.begin(), tail.end());
+        ends.push_back(buffer.size());
+    }
+
+    // Sends what the socket takes without blocking; false once it failed
+    bool flush(Socket& socket)
+    {
+        while (pending())
+        {
+            const ptrdiff_t n = socket.sendSome(buffer.data() + sent, buffer.size() - sent);
+            if (n < 0 && Socket::wouldBlock())
+                break;
+            if (n <= 0)
+                return false;
+            sent += size_t(n);
+        }
+        while (!ends.empty() && ends.front() <= sent)
+            ends.pop_front();
+        // Sent bytes are dropped once they are the larger part, so each is moved at most once
+        if (!pending() || sent > buffer.size() / 2)
+        {
+            buffer.erase(buffer.begin(), buffer.begin() + ptrdiff_t(sent));
+            for (size_t& end : ends)
+                end -= sent;
+            sent = 0;
+        }
+        return true;
+    }
+};
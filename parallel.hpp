@@ -0,0 +1,415 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "perf_counter.hpp"
+
+struct JobSystem;
+struct JobCounter;
+
+// A unit of work, type-erased without allocation. `context` belongs to the submitter and must
+// outlive the job; `begin`/`end` is the job's share of a loop.
+struct Job
+{
+    void (*run)(JobSystem& jobs, const Job& job) = nullptr;
+    void* context = nullptr;
+    size_t begin = 0, end = 0;
+    JobCounter* counter = nullptr; // counted down when the job finishes
+};
+
+// Unfinished jobs of a group. Wait on it, or chain jobs to start once it reaches zero.
+struct JobCounter
+{
+    static constexpr int MAX_CONTINUATIONS = 8;
+
+    std::atomic<size_t> pending = 0;
+    std::mutex mutex; // guards the continuations and the final decrement
+    std::array<Job, MAX_CONTINUATIONS> continuations{};
+    int continuationCount = 0;
+
+    bool done() const
+    {
+        return pending.load(std::memory_order_acquire) == 0;
+    }
+};
+
+// Work-stealing job system shared by every parallel loop in the program.
+//
+// Each worker owns a bounded deque: it pushes and pops at the back, idle workers steal from the
+// front, so thieves take the oldest and largest pieces. Threads outside the system (render,
+// simulation) share one extra deque, and a thread waiting on a counter runs jobs instead of
+// blocking, which makes loops reentrant and lets the render and simulation threads submit at once.
+// With no workers everything runs inline on the caller.
+struct JobSystem
+{
+    struct WorkerStats
+    {
+        uint64_t jobs;          // jobs executed
+        uint64_t steals;        // jobs taken from other deques
+        uint64_t failedSteals;  // deques found empty or raced for
+        size_t depth, maxDepth; // jobs queued now, and at most since `resetStats`
+        double idleSeconds;     // asleep or searching without finding work
+    };
+
+    struct alignas(64) Queue
+    {
+        static constexpr size_t CAPACITY = 256; // a full deque runs new jobs inline
+
+        std::mutex mutex;
+        std::array<Job, CAPACITY> ring{};
+        std::atomic<size_t> head = 0; // next to steal, advanced under `mutex`
+        std::atomic<size_t> tail = 0; // next free, moved under `mutex`
+
+        std::atomic<uint64_t> jobs = 0, steals = 0, failedSteals = 0;
+        std::atomic<uint64_t> idleNanos = 0;
+        std::atomic<size_t> maxDepth = 0;
+
+        size_t depth() const
+        {
+            return tail.load(std::memory_order_relaxed) - head.load(std::memory_order_relaxed);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<Queue> queues; // one per worker, then the one shared by outside threads
+    std::vector<std::atomic<int>> threadIds; // each worker's osThreadId, 0 until it has started
+
+    std::atomic<size_t> queued = 0; // jobs in all deques
+    std::atomic<int> sleepers = 0;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool quit = false; // guarded by `sleepMutex`
+
+    static inline thread_local JobSystem* owner = nullptr;
+    static inline thread_local size_t ownSlot = 0;
+
+    explicit JobSystem(unsigned threads = std::max(1u, std::thread::hardware_concurrency()))
+        : queues(threads), threadIds(threads - 1)
+    {
+        for (unsigned i = 1; i < threads; ++i)
+            workers.emplace_back([this, i] { workerLoop(i - 1); });
+    }
+
+    ~JobSystem()
+    {
+        {
+            std::lock_guard lock(sleepMutex);
+            quit = true;
+        }
+        wake.notify_all();
+        for (auto& t : workers)
+            t.join();
+    }
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // Threads that run loops, counting the caller
+    size_t size() const
+    {
+        return workers.size() + 1;
+    }
+
+    // Deque of the calling thread
+    size_t slot() const
+    {
+        return owner == this ? ownSlot : queues.size() - 1;
+    }
+
+    // Runs fn(chunk, begin, end) for `numChunks` contiguous chunks of [0, count), blocks until done.
+    // Chunk boundaries depend only on `count` and `numChunks`, never on scheduling.
+    template <typename Fn>
+    void parallelForChunks(size_t n, size_t numChunks, Fn&& body)
+    {
+        numChunks = std::max<size_t>(1, std::min(numChunks, n));
+        if (n == 0)
+            return;
+        auto chunks = [&](size_t first, size_t last)
+        {
+            for (size_t c = first; c < last; ++c)
+                body(c, n * c / numChunks, n * (c + 1) / numChunks);
+        };
+        if (numChunks == 1 || workers.empty())
+            chunks(0, numChunks);
+        else
+            forRange(numChunks, 1, chunks);
+    }
+
+    // Runs fn(begin, end) over disjoint ranges covering [0, count), blocks until done. Ranges are
+    // split only while other threads are hungry for work, down to a grain of a few dozen per thread.
+    template <typename Fn>
+    void parallelFor(size_t n, Fn&& body)
+    {
+        if (n == 0)
+            return;
+        if (n == 1 || workers.empty())
+            body(size_t(0), n);
+        else
+            forRange(n, std::max<size_t>(1, n / (size() * 32)), body);
+    }
+
+    // Runs fn() as a job of `counter`; `fn` must stay alive until the counter is waited on
+    template <typename Fn>
+    void run(JobCounter& counter, Fn& fn)
+    {
+        counter.pending.fetch_add(1, std::memory_order_relaxed);
+        submit({&invokeCallable<Fn>, &fn, 0, 0, &counter});
+    }
+
+    // Runs fn() as a job nobody waits on, inline when there are no workers; `fn` must stay alive
+    // until it has run
+    template <typename Fn>
+    void detach(Fn& fn)
+    {
+        const Job job{&invokeCallable<Fn>, &fn, 0, 0, nullptr};
+        if (workers.empty())
+            execute(job);
+        else
+            submit(job);
+    }
+
+    // Runs fn() as a job of `counter` once `dependency` reaches zero
+    template <typename Fn>
+    void after(JobCounter& dependency, JobCounter& counter, Fn& fn)
+    {
+        counter.pending.fetch_add(1, std::memory_order_relaxed);
+        const Job job{&invokeCallable<Fn>, &fn, 0, 0, &counter};
+        {
+            std::lock_guard lock(dependency.mutex);
+            if (!dependency.done() && dependency.continuationCount < JobCounter::MAX_CONTINUATIONS)
+            {
+                dependency.continuations[dependency.continuationCount++] = job;
+                return;
+            }
+        }
+        wait(dependency); // done already, or out of continuation slots
+        submit(job);
+    }
+
+    // Runs queued jobs until `counter` reaches zero
+    void wait(JobCounter& counter)
+    {
+        const size_t self = slot();
+        std::chrono::steady_clock::time_point idleSince{};
+        while (!counter.done())
+        {
+            if (runOne(self))
+            {
+                idleSince = {};
+                continue;
+            }
+            // The last jobs are running elsewhere
+            const auto now = std::chrono::steady_clock::now();
+            if (idleSince != std::chrono::steady_clock::time_point{})
+                queues[self].idleNanos.fetch_add(uint64_t(std::chrono::nanoseconds(now - idleSince).count()), std::memory_order_relaxed);
+            idleSince = now;
+            std::this_thread::yield();
+        }
+        // `finish` may still hold the lock after the last decrement
+        std::lock_guard lock(counter.mutex);
+    }
+
+    WorkerStats stats(size_t i) const
+    {
+        const Queue& q = queues[i];
+        return {q.jobs.load(std::memory_order_relaxed), q.steals.load(std::memory_order_relaxed),
+                q.failedSteals.load(std::memory_order_relaxed), q.depth(), q.maxDepth.load(std::memory_order_relaxed),
+                double(q.idleNanos.load(std::memory_order_relaxed)) * 1e-9};
+    }
+
+    void resetStats()
+    {
+        for (Queue& q : queues)
+        {
+            q.jobs = 0;
+            q.steals = 0;
+            q.failedSteals = 0;
+            q.idleNanos = 0;
+            q.maxDepth = q.depth();
+        }
+    }
+
+    struct RangeLoop
+    {
+        void (*invoke)(void* fn, size_t begin, size_t end);
+        void* fn;
+        size_t grain;
+    };
+
+    template <typename Fn>
+    static void invokeCallable(JobSystem&, const Job& job)
+    {
+        (*static_cast<Fn*>(job.context))();
+    }
+
+    template <typename Fn>
+    void forRange(size_t n, size_t grain, Fn& body)
+    {
+        RangeLoop loop{[](void* f, size_t begin, size_t end)
+                       { (*static_cast<Fn*>(f))(begin, end); },
+                       &body, grain};
+        JobCounter done;
+        done.pending = 1;
+        execute({&runRange, &loop, 0, n, &done});
+        wait(done);
+    }
+
+    // Lazy binary splitting: between grains, the upper half of what is left goes to the deque if
+    // the deque is empty, i.e. once a thief has taken the last piece offered
+    static void runRange(JobSystem& jobs, const Job& job)
+    {
+        const RangeLoop& loop = *static_cast<const RangeLoop*>(job.context);
+        const size_t self = jobs.slot();
+        size_t begin = job.begin, end = job.end;
+        while (begin < end)
+        {
+            if (end - begin > 2 * loop.grain && jobs.queues[self].depth() == 0)
+            {
+                const size_t mid = begin + (end - begin) / 2;
+                job.counter->pending.fetch_add(1, std::memory_order_relaxed);
+                jobs.submit({&runRange, job.context, mid, end, job.counter});
+                end = mid;
+                continue;
+            }
+            const size_t stop = std::min(end, begin + loop.grain);
+            loop.invoke(loop.fn, begin, stop);
+            begin = stop;
+        }
+    }
+
+    void submit(const Job& job)
+    {
+        if (!push(slot(), job))
+        {
+            execute(job);
+            return;
+        }
+        queued.fetch_add(1);
+        if (sleepers.load() > 0)
+        {
+            {
+                std::lock_guard lock(sleepMutex);
+            }
+            wake.notify_one();
+        }
+    }
+
+    bool push(size_t i, const Job& job)
+    {
+        Queue& q = queues[i];
+        std::lock_guard lock(q.mutex);
+        const size_t t = q.tail.load(std::memory_order_relaxed);
+        const size_t depth = t - q.head.load(std::memory_order_relaxed);
+        if (depth == Queue::CAPACITY)
+            return false;
+        q.ring[t % Queue::CAPACITY] = job;
+        q.tail.store(t + 1, std::memory_order_relaxed);
+        if (depth + 1 > q.maxDepth.load(std::memory_order_relaxed))
+            q.maxDepth.store(depth + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool pop(size_t i, Job& job)
+    {
+        Queue& q = queues[i];
+        std::lock_guard lock(q.mutex);
+        const size_t t = q.tail.load(std::memory_order_relaxed);
+        if (t == q.head.load(std::memory_order_relaxed))
+            return false;
+        job = q.ring[(t - 1) % Queue::CAPACITY];
+        q.tail.store(t - 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool steal(size_t i, Job& job)
+    {
+        Queue& q = queues[i];
+        if (q.depth() == 0)
+            return false;
+        std::lock_guard lock(q.mutex);
+        const size_t h = q.head.load(std::memory_order_relaxed);
+        if (h == q.tail.load(std::memory_order_relaxed))
+            return false;
+        job = q.ring[h % Queue::CAPACITY];
+        q.head.store(h + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Pops from the own deque, else steals, starting after itself so thieves spread out
+    bool runOne(size_t self)
+    {
+        Job job;
+        bool found = pop(self, job);
+        for (size_t k = 1; !found && k < queues.size(); ++k)
+        {
+            const size_t victim = (self + k) % queues.size();
+            if (queues[victim].depth() == 0)
+                continue;
+            found = steal(victim, job);
+            (found ? queues[self].steals : queues[self].failedSteals).fetch_add(1, std::memory_order_relaxed);
+        }
+        if (!found)
+            return false;
+        queued.fetch_sub(1);
+        execute(job);
+        return true;
+    }
+
+    void execute(const Job& job)
+    {
+        job.run(*this, job);
+        queues[slot()].jobs.fetch_add(1, std::memory_order_relaxed);
+        finish(job.counter);
+    }
+
+    void finish(JobCounter* counter)
+    {
+        if (!counter)
+            return;
+        std::array<Job, JobCounter::MAX_CONTINUATIONS> ready;
+        int count;
+        {
+            std::lock_guard lock(counter->mutex);
+            if (counter->pending.fetch_sub(1, std::memory_order_acq_rel) != 1)
+                return;
+            count = std::exchange(counter->continuationCount, 0);
+            std::copy_n(counter->continuations.begin(), count, ready.begin());
+        }
+        for (int i = 0; i < count; ++i)
+            submit(ready[i]);
+    }
+
+    void workerLoop(size_t index)
+    {
+        owner = this;
+        ownSlot = index;
+        threadIds[index].store(osThreadId(), std::memory_order_relaxed);
+        while (true)
+        {
+            if (runOne(index))
+                continue;
+
+            const auto start = std::chrono::steady_clock::now();
+            {
+                std::unique_lock lock(sleepMutex);
+                ++sleepers;
+                wake.wait(lock, [this] { return quit || queued.load() > 0; });
+                --sleepers;
+                if (quit)
+                    return;
+            }
+            queues[index].idleNanos.fetch_add(uint64_t(std::chrono::nanoseconds(std::chrono::steady_clock::now() - start).count()),
+                                              std::memory_order_relaxed);
+        }
+    }
+};
@@ -0,0 +1,361 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstring>
+#include <numbers>
+#include <span>
+#include <vector>
+
+// Particle-mesh (PM) gravity solver on an isolated cube centred at the origin.
+//
+// Mass is deposited onto an N^3 mesh with cloud-in-cell (CIC) weights and convolved with the
+// Green's function by FFT on a zero-padded (2N)^3 mesh (Hockney's method, so there are no
+// periodic images). The Green's function is only the erf-softened long-range part of -G/r.
+// With `shortRange` on, the complementary erfc part is summed directly over nearby sources
+// (P3M), which restores the Newtonian force and potential at close range.
+struct ParticleMesh
+{
+    using cfloat = std::complex<float>;
+
+    // Gravity sources as SoA columns; `radius` switches off the short-range part inside a body
+    struct Sources
+    {
+        std::span<const float> x, y, z;
+        std::span<const float> mass;
+        std::span<const float> radius;
+    };
+
+    bool shortRange = true;
+
+    int n;            // mesh cells per axis
+    int m;            // padded FFT size per axis (2n)
+    float half;       // half edge of the mesh cube in meters
+    float h;          // cell size in meters
+    float split;      // long/short-range split scale in meters
+    float cutoff;     // short-range cutoff in meters
+    double gravConst; // G
+
+    std::vector<cfloat> green;   // FFT of the long-range Green's function, pre-scaled by 1/m^3
+    std::vector<cfloat> mesh;    // padded work mesh
+    std::vector<cfloat> twiddle; // exp(-2 pi i k / m), k < m / 2
+    std::vector<cfloat> line;    // gather/scatter buffer for one FFT line
+
+    std::vector<float> phi;            // potential, n^3, x fastest
+    std::vector<float> gx, gy, gz;     // mesh acceleration -grad(phi), n^3
+    bool solved = false;               // phi/g hold the field of the last `solve`
+    unsigned version = 0;              // bumped by every `solve`
+    size_t outside = 0;                // sources outside the mesh in the last `solve`
+
+    // Short-range neighbour search: sources binned into chain cells of at least `cutoff`
+    int chainCells = 1;
+    float chainSize = 0.0f;
+    std::vector<int> chainStart;
+    std::vector<int> chainIndex;
+    std::vector<int> chainFill;
+    Sources sources;
+
+    ParticleMesh(int cells, float halfExtent, double G)
+        : n(cells)
+        , m(2 * cells)
+        , half(halfExtent)
+        , h(2.0f * halfExtent / cells)
+        , split(2.0f * h)
+        , cutoff(4.5f * split)
+        , gravConst(G)
+    {
+        const size_t padded = size_t(m) * m * m;
+        mesh.resize(padded);
+        green.resize(padded);
+        line.resize(m);
+        twiddle.resize(m / 2);
+        for (int k = 0; k < m / 2; ++k)
+            twiddle[k] = std::polar(1.0f, -2.0f * std::numbers::pi_v<float> * k / m);
+
+        const size_t cellCount = size_t(n) * n * n;
+        phi.resize(cellCount);
+        gx.resize(cellCount);
+        gy.resize(cellCount);
+        gz.resize(cellCount);
+
+        chainCells = std::max(1, int(2.0f * half / cutoff));
+        chainSize = 2.0f * half / chainCells;
+        chainStart.resize(size_t(chainCells) * chainCells * chainCells + 1);
+
+        // Real-space long-range Green's function, displacements wrapped into [-m/2, m/2)
+        const double s = split;
+        for (int k = 0; k < m; ++k)
+            for (int j = 0; j < m; ++j)
+                for (int i = 0; i < m; ++i)
+                {
+                    const double dx = (i < m / 2 ? i : i - m) * double(h);
+                    const double dy = (j < m / 2 ? j : j - m) * double(h);
+                    const double dz = (k < m / 2 ? k : k - m) * double(h);
+                    const double r = std::sqrt(dx * dx + dy * dy + dz * dz);
+                    const double g = r > 0.0 ? -gravConst * std::erf(r / (2.0 * s)) / r
+                                             : -gravConst / (s * std::sqrt(std::numbers::pi));
+                    green[index(i, j, k)] = cfloat(static_cast<float>(g), 0.0f);
+                }
+        fft3d(green, false, false);
+        const float scale = 1.0f / (float(m) * m * m);
+        for (auto& v : green)
+            v *= scale;
+    }
+
+    size_t index(int i, int j, int k) const
+    {
+        return (size_t(k) * m + j) * m + i;
+    }
+
+    size_t cell(int i, int j, int k) const
+    {
+        return (size_t(k) * n + j) * n + i;
+    }
+
+    // Deposit `src`, convolve, and refresh the potential and acceleration meshes
+    void solve(const Sources& src)
+    {
+        sources = src;
+        std::memset(static_cast<void*>(mesh.data()), 0, mesh.size() * sizeof(cfloat));
+
+        // 1) CIC deposit
+        outside = 0;
+        for (size_t p = 0; p < src.mass.size(); ++p)
+        {
+            int i0, j0, k0;
+            float fx, fy, fz;
+            if (!meshCoord(src.x[p], src.y[p], src.z[p], i0, j0, k0, fx, fy, fz))
+            {
+                ++outside;
+                continue;
+            }
+            for (int c = 0; c < 8; ++c)
+            {
+                const int i = i0 + (c & 1), j = j0 + ((c >> 1) & 1), k = k0 + (c >> 2);
+                if (i < 0 || j < 0 || k < 0 || i >= n || j >= n || k >= n)
+                    continue;
+                const float w = ((c & 1) ? fx : 1.0f - fx) * ((c & 2) ? fy : 1.0f - fy) * ((c & 4) ? fz : 1.0f - fz);
+                mesh[index(i, j, k)] += w * src.mass[p];
+            }
+        }
+
+        // 2) convolve with the Green's function in Fourier space
+        fft3d(mesh, false, true);
+        for (size_t i = 0; i < mesh.size(); ++i)
+            mesh[i] *= green[i];
+        fft3d(mesh, true, true);
+
+        for (int k = 0; k < n; ++k)
+            for (int j = 0; j < n; ++j)
+                for (int i = 0; i < n; ++i)
+                    phi[cell(i, j, k)] = mesh[index(i, j, k)].real();
+
+        // 3) mesh acceleration by central differences, one-sided at the faces
+        for (int k = 0; k < n; ++k)
+            for (int j = 0; j < n; ++j)
+                for (int i = 0; i < n; ++i)
+                {
+                    const int il = std::max(i - 1, 0), ih = std::min(i + 1, n - 1);
+                    const int jl = std::max(j - 1, 0), jh = std::min(j + 1, n - 1);
+                    const int kl = std::max(k - 1, 0), kh = std::min(k + 1, n - 1);
+                    const size_t c = cell(i, j, k);
+                    gx[c] = -(phi[cell(ih, j, k)] - phi[cell(il, j, k)]) / ((ih - il) * h);
+                    gy[c] = -(phi[cell(i, jh, k)] - phi[cell(i, jl, k)]) / ((jh - jl) * h);
+                    gz[c] = -(phi[cell(i, j, kh)] - phi[cell(i, j, kl)]) / ((kh - kl) * h);
+                }
+
+        // 4) bin sources for the short-range sum
+        std::fill(chainStart.begin(), chainStart.end(), 0);
+        chainIndex.resize(src.mass.size());
+        for (size_t p = 0; p < src.mass.size(); ++p)
+            ++chainStart[chainOf(src.x[p], src.y[p], src.z[p]) + 1];
+        for (size_t c = 1; c < chainStart.size(); ++c)
+            chainStart[c] += chainStart[c - 1];
+        chainFill.assign(chainStart.begin(), chainStart.end() - 1);
+        for (size_t p = 0; p < src.mass.size(); ++p)
+            chainIndex[chainFill[chainOf(src.x[p], src.y[p], src.z[p])]++] = static_cast<int>(p);
+
+        solved = true;
+        ++version;
+    }
+
+    // Total potential at a point (mesh part plus, with `shortRange`, the direct erfc part)
+    float potential(float x, float y, float z) const
+    {
+        float result = interpolate(phi, x, y, z);
+        if (shortRange)
+        {
+            forEachNeighbour(x, y, z, [&](int p, float dx, float dy, float dz)
+                             {
+                                 const float rad = sources.radius.empty() ? 0.0f : sources.radius[p];
+                                 const float r = std::max(std::sqrt(dx * dx + dy * dy + dz * dz), std::max(rad, 1e-3f * h));
+                                 result -= static_cast<float>(gravConst * sources.mass[p]) * std::erfc(r / (2.0f * split)) / r; });
+        }
+        return result;
+    }
+
+    // Accelerations at target points; `targetsAreSources` skips each target's own short-range term
+    void accelerations(std::span<const float> x, std::span<const float> y, std::span<const float> z,
+                       std::span<float> ax, std::span<float> ay, std::span<float> az, bool targetsAreSources) const
+    {
+        const float norm = 1.0f / (split * std::sqrt(std::numbers::pi_v<float>));
+        for (size_t t = 0; t < x.size(); ++t)
+        {
+            float accX = interpolate(gx, x[t], y[t], z[t]);
+            float accY = interpolate(gy, x[t], y[t], z[t]);
+            float accZ = interpolate(gz, x[t], y[t], z[t]);
+
+            if (shortRange)
+            {
+                forEachNeighbour(x[t], y[t], z[t], [&](int p, float dx, float dy, float dz)
+                                 {
+                                     if (targetsAreSources && size_t(p) == t)
+                                         return;
+                                     const float r2 = dx * dx + dy * dy + dz * dz;
+                                     const float rad = sources.radius.empty() ? 0.0f : sources.radius[p];
+                                     if (r2 <= rad * rad || r2 == 0.0f)
+                                         return;
+                                     const float r = std::sqrt(r2);
+                                     const float u = r / (2.0f * split);
+                                     const float shape = std::erfc(u) + r * norm * std::exp(-u * u);
+                                     const float a = static_cast<float>(gravConst * sources.mass[p]) * shape / (r2 * r);
+                                     accX += dx * a;
+                                     accY += dy * a;
+                                     accZ += dz * a; });
+            }
+
+            ax[t] = accX;
+            ay[t] = accY;
+            az[t] = accZ;
+        }
+    }
+
+    // Cell-centred CIC coordinates; false if the point's cloud misses the mesh entirely
+    bool meshCoord(float x, float y, float z, int& i, int& j, int& k, float& fx, float& fy, float& fz) const
+    {
+        const float u = (x + half) / h - 0.5f, v = (y + half) / h - 0.5f, w = (z + half) / h - 0.5f;
+        if (u <= -1.0f || v <= -1.0f || w <= -1.0f || u >= float(n) || v >= float(n) || w >= float(n))
+            return false;
+        i = int(std::floor(u));
+        j = int(std::floor(v));
+        k = int(std::floor(w));
+        fx = u - i;
+        fy = v - j;
+        fz = w - k;
+        return true;
+    }
+
+    float interpolate(const std::vector<float>& field, float x, float y, float z) const
+    {
+        int i0, j0, k0;
+        float fx, fy, fz;
+        if (!meshCoord(x, y, z, i0, j0, k0, fx, fy, fz))
+            return 0.0f;
+        float result = 0.0f;
+        for (int c = 0; c < 8; ++c)
+        {
+            const int i = std::clamp(i0 + (c & 1), 0, n - 1);
+            const int j = std::clamp(j0 + ((c >> 1) & 1), 0, n - 1);
+            const int k = std::clamp(k0 + (c >> 2), 0, n - 1);
+            const float w = ((c & 1) ? fx : 1.0f - fx) * ((c & 2) ? fy : 1.0f - fy) * ((c & 4) ? fz : 1.0f - fz);
+            result += w * field[cell(i, j, k)];
+        }
+        return result;
+    }
+
+    int chainCoord(float v) const
+    {
+        return std::clamp(int((v + half) / chainSize), 0, chainCells - 1);
+    }
+
+    int chainOf(float x, float y, float z) const
+    {
+        return (chainCoord(z) * chainCells + chainCoord(y)) * chainCells + chainCoord(x);
+    }
+
+    // Calls fn(source, dx, dy, dz) for every source within `cutoff`, d pointing from the point to the source
+    template <typename Fn>
+    void forEachNeighbour(float x, float y, float z, Fn&& fn) const
+    {
+        const int ci = chainCoord(x), cj = chainCoord(y), ck = chainCoord(z);
+        const float cutoff2 = cutoff * cutoff;
+        for (int k = std::max(ck - 1, 0); k <= std::min(ck + 1, chainCells - 1); ++k)
+            for (int j = std::max(cj - 1, 0); j <= std::min(cj + 1, chainCells - 1); ++j)
+                for (int i = std::max(ci - 1, 0); i <= std::min(ci + 1, chainCells - 1); ++i)
+                {
+                    const int c = (k * chainCells + j) * chainCells + i;
+                    for (int q = chainStart[c]; q < chainStart[c + 1]; ++q)
+                    {
+                        const int p = chainIndex[q];
+                        const float dx = sources.x[p] - x, dy = sources.y[p] - y, dz = sources.z[p] - z;
+                        if (dx * dx + dy * dy + dz * dz < cutoff2)
+                            fn(p, dx, dy, dz);
+                    }
+                }
+    }
+
+    // In-place radix-2 FFT of one line of length m (unnormalised)
+    void fftLine(cfloat* a, bool inverse) const
+    {
+        for (int i = 1, j = 0; i < m; ++i)
+        {
+            int bit = m >> 1;
+            for (; j & bit; bit >>= 1)
+                j ^= bit;
+            j ^= bit;
+            if (i < j)
+                std::swap(a[i], a[j]);
+        }
+        for (int len = 2; len <= m; len <<= 1)
+        {
+            const int step = m / len;
+            for (int i = 0; i < m; i += len)
+                for (int k = 0; k < len / 2; ++k)
+                {
+                    const cfloat w = inverse ? std::conj(twiddle[k * step]) : twiddle[k * step];
+                    const cfloat u = a[i + k];
+                    const cfloat v = a[i + k + len / 2] * w;
+                    a[i + k] = u + v;
+                    a[i + k + len / 2] = u - v;
+                }
+        }
+    }
+
+    void transformLines(cfloat* f, size_t stride, size_t strideA, int countA, size_t strideB, int countB, bool inverse)
+    {
+        for (int b = 0; b < countB; ++b)
+            for (int a = 0; a < countA; ++a)
+            {
+                cfloat* base = f + a * strideA + b * strideB;
+                for (int i = 0; i < m; ++i)
+                    line[i] = base[i * stride];
+                fftLine(line.data(), inverse);
+                for (int i = 0; i < m; ++i)
+                    base[i * stride] = line[i];
+            }
+    }
+
+    // 3D FFT of a padded mesh. With `pruned`, input is only non-zero in the first n^3 block and only
+    // that block is read back, so lines that are all zero (forward) or unused (inverse) are skipped.
+    void fft3d(std::vector<cfloat>& f, bool inverse, bool pruned)
+    {
+        const int lim = pruned ? n : m;
+        const size_t mm = size_t(m) * m;
+        auto xPass = [&] { transformLines(f.data(), 1, m, lim, mm, lim, inverse); };
+        auto yPass = [&] { transformLines(f.data(), m, 1, m, mm, lim, inverse); };
+        auto zPass = [&] { transformLines(f.data(), mm, 1, m, m, m, inverse); };
+        if (!inverse)
+        {
+            xPass();
+            yPass();
+            zPass();
+        }
+        else
+        {
+            zPass();
+            yPass();
+            xPass();
+        }
+    }
+};
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// The calling thread's id as perf events know it (Linux), else 0
+inline int osThreadId()
+{
+#ifdef __linux__
+    return static_cast<int>(syscall(SYS_gettid));
+#else
+    return 0;
+#endif
+}
+
+// Hardware cache-miss counter for one thread: the calling thread, or the one with osThreadId `tid`.
+// Uses Linux perf events; elsewhere, or when perf_event_paranoid forbids it, every reading is 0.
+struct CacheMissCounter
+{
+    int fd = -1;
+
+    explicit CacheMissCounter(int tid = 0)
+    {
+#ifdef __linux__
+        perf_event_attr attr{};
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, tid, -1, -1, 0));
+#endif
+    }
+
+    ~CacheMissCounter()
+    {
+#ifdef __linux__
+        if (fd >= 0)
+            close(fd);
+#endif
+    }
+
+    CacheMissCounter(const CacheMissCounter&) = delete;
+    CacheMissCounter& operator=(const CacheMissCounter&) = delete;
+
+    bool available() const
+    {
+        return fd >= 0;
+    }
+
+    void start()
+    {
+#ifdef __linux__
+        if (fd < 0)
+            return;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+
+    uint64_t stop()
+    {
+        uint64_t count = 0;
+#ifdef __linux__
+        if (fd < 0)
+            return 0;
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &count, sizeof(count)) != sizeof(count))
+            count = 0;
+#endif
+        return count;
+    }
+};
+
+// Cache misses of the calling thread and the threads `tids`, summed, for work spread across the
+// job system's workers. A worker counts whatever jobs it runs meanwhile, not only ours.
+struct CacheMissGroup
+{
+    std::vector<std::unique_ptr<CacheMissCounter>> counters;
+
+    explicit CacheMissGroup(std::span<const int> tids)
+    {
+        counters.push_back(std::make_unique<CacheMissCounter>());
+        for (int tid : tids)
+            counters.push_back(std::make_unique<CacheMissCounter>(tid));
+    }
+
+    // Only when every thread is counted, so a partial sum is never reported
+    bool available() const
+    {
+        for (const auto& c : counters)
+            if (!c->available())
+                return false;
+        return true;
+    }
+
+    void start()
+    {
+        for (auto& c : counters)
+            c->start();
+    }
+
+    uint64_t stop()
+    {
+        uint64_t count = 0;
+        for (auto& c : counters)
+            count += c->stop();
+        return count;
+    }
+};
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// QOI, "the Quite OK Image format" (https://qoiformat.org): lossless RGB(A), close to PNG in size
+// for rendered frames and an order of magnitude faster to encode. One image is encoded serially;
+// encode several images at once for throughput.
+
+// Bytes `qoiEncode` may write at most
+constexpr size_t qoiMaxSize(int width, int height, int channels)
+{
+    return 14 + size_t(width) * height * (channels + 1) + 8;
+}
+
+// Encodes tightly packed top-down rows of 3 (RGB) or 4 (RGBA) channels into `out`, which must
+// hold qoiMaxSize bytes; returns the bytes written
+inline size_t qoiEncode(const uint8_t* pixels, int width, int height, int channels, uint8_t* out)
+{
+    enum : uint8_t
+    {
+        OP_INDEX = 0x00,
+        OP_DIFF = 0x40,
+        OP_LUMA = 0x80,
+        OP_RUN = 0xc0,
+        OP_RGB = 0xfe,
+        OP_RGBA = 0xff,
+    };
+    struct Pixel
+    {
+        uint8_t r = 0, g = 0, b = 0, a = 0;
+
+        bool operator==(const Pixel&) const = default;
+    };
+
+    uint8_t* p = out;
+    auto put32 = [&](uint32_t v)
+    {
+        *p++ = uint8_t(v >> 24);
+        *p++ = uint8_t(v >> 16);
+        *p++ = uint8_t(v >> 8);
+        *p++ = uint8_t(v);
+    };
+    *p++ = 'q';
+    *p++ = 'o';
+    *p++ = 'i';
+    *p++ = 'f';
+    put32(uint32_t(width));
+    put32(uint32_t(height));
+    *p++ = uint8_t(channels);
+    *p++ = 0; // sRGB with linear alpha
+
+    std::array<Pixel, 64> seen{};
+    Pixel previous{0, 0, 0, 255};
+    int run = 0;
+    const size_t count = size_t(width) * height;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const uint8_t* src = pixels + i * channels;
+        const Pixel px{src[0], src[1], src[2], channels == 4 ? src[3] : uint8_t(255)};
+        if (px == previous)
+        {
+            if (++run == 62 || i + 1 == count)
+            {
+                *p++ = uint8_t(OP_RUN | (run - 1));
+                run = 0;
+            }
+            continue;
+        }
+        if (run > 0)
+        {
+            *p++ = uint8_t(OP_RUN | (run - 1));
+            run = 0;
+        }
+
+        const int hash = (px.r * 3 + px.g * 5 + px.b * 7 + px.a * 11) % 64;
+        if (seen[hash] == px)
+        {
+            *p++ = uint8_t(OP_INDEX | hash);
+        }
+        else
+        {
+            seen[hash] = px;
+            if (px.a == previous.a)
+            {
+                const int8_t dr = int8_t(px.r - previous.r);
+                const int8_t dg = int8_t(px.g - previous.g);
+                const int8_t db = int8_t(px.b - previous.b);
+                const int8_t drg = int8_t(dr - dg);
+                const int8_t dbg = int8_t(db - dg);
+                if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+                {
+                    *p++ = uint8_t(OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+                }
+                else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7)
+                {
+                    *p++ = uint8_t(OP_LUMA | (dg + 32));
+                    *p++ = uint8_t((drg + 8) << 4 | (dbg + 8));
+                }
+                else
+                {
+                    *p++ = OP_RGB;
+                    *p++ = px.r;
+                    *p++ = px.g;
+                    *p++ = px.b;
+                }
+            }
+            else
+            {
+                *p++ = OP_RGBA;
+                *p++ = px.r;
+                *p++ = px.g;
+                *p++ = px.b;
+                *p++ = px.a;
+            }
+        }
+        previous = px;
+    }
+
+    for (int i = 0; i < 7; ++i)
+        *p++ = 0;
+    *p++ = 1;
+    return size_t(p - out);
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "cache.hpp"
+
+// Frames on request over TCP (--serve; net.hpp). A client sends SERVE_REQUEST messages, as many
+// as it likes without waiting, and gets one SERVE_REPLY per request in completion order, matched
+// by id: the frame as QOI when the status is Ok, nothing else when it is Busy (the queue was full;
+// try again later) or Invalid. Poses are snapped to FrameKey steps, and repeated ones are answered
+// from a cache (cache.hpp).
+enum ServeMessage : uint32_t
+{
+    SERVE_REQUEST = 1,
+    SERVE_REPLY,
+};
+
+enum class ServeStatus : int32_t
+{
+    Ok,
+    Busy,
+    Invalid,
+};
+
+struct ServeRequest
+{
+    uint32_t id;
+    float radius, azimuth, elevation; // meters and radians, as for --camera
+    int32_t width, height;
+    int32_t quality; // 1 to 4 rays per pixel edge
+    uint32_t flags;  // SERVE_LENSING
+};
+
+// Also send the lensing map: the tracer's AOVs for each output pixel, as a multi-layer EXR (--aov)
+constexpr uint32_t SERVE_LENSING = 1;
+
+// Followed by the QOI image when the status is Ok, then the lensing map if asked for
+struct ServeReply
+{
+    uint32_t id;
+    ServeStatus status;
+    int32_t width, height;
+    float queueMs = 0.0f, renderMs = 0.0f, encodeMs = 0.0f; // waiting for a batch, tracing and reading back, encoding
+    FrameCache::Tier cache = FrameCache::Tier::Miss;         // where a repeated frame came from, its times all 0
+    uint32_t frameBytes = 0;                                 // of the QOI image; the lensing map is the rest
+};
+
+// Requests waiting for the GPU, oldest first, up to a fixed number
+struct ServeQueue
+{
+    struct Entry
+    {
+        ServeRequest request; // snapped to `key`
+        FrameKey key;
+        size_t client;
+        double received;
+    };
+
+    size_t capacity = 64;
+    std::deque<Entry> entries;
+
+    bool full() const
+    {
+        return entries.size() >= capacity;
+    }
+
+    // Views from the same radius and elevation at the same size differ only by a turn about the
+    // y axis, so they trace in one dispatch (Engine::traceLayers). Lensing maps are traced alone.
+    static bool batchable(const ServeRequest& a, const ServeRequest& b)
+    {
+        return !((a.flags | b.flags) & SERVE_LENSING) && a.radius == b.radius && a.elevation == b.elevation && a.width == b.width && a.height == b.height && a.quality == b.quality;
+    }
+
+    // The oldest request and up to max - 1 later ones it can batch with, in arrival order
+    void takeBatch(size_t max, std::vector<Entry>& batch)
+    {
+        batch.clear();
+        if (entries.empty())
+            return;
+        batch.push_back(entries.front());
+        entries.pop_front();
+        for (auto it = entries.begin(); it != entries.end() && batch.size() < max;)
+        {
+            if (batchable(batch.front().request, it->request))
+            {
+                batch.push_back(*it);
+                it = entries.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+};
+
+// The latest latencies of one kind, in milliseconds
+struct LatencySamples
+{
+    static constexpr size_t CAPACITY = 4096;
+
+    std::array<float, CAPACITY> samples{};
+    size_t count = 0;
+
+    void add(double ms)
+    {
+        samples[count++ % CAPACITY] = float(ms);
+    }
+
+    // p in [0, 1] over the kept samples, 0 without any
+    float percentile(double p) const
+    {
+        const size_t n = std::min(count, CAPACITY);
+        if (n == 0)
+            return 0.0f;
+        std::vector<float> sorted(samples.begin(), samples.begin() + n);
+        const size_t k = std::min(n - 1, size_t(p * n));
+        std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+        return sorted[k];
+    }
+};
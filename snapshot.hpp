@@ -0,0 +1,401 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "alloc_tracker.hpp"
+#include "parallel.hpp"
+
+// Binary snapshot of simulation state: a header, a column directory, then one block per SoA
+// column. Blocks start on SNAPSHOT_ALIGN boundaries, so a mapped file hands out page-aligned
+// arrays that are used in place, with no parsing. Little-endian, native float layout.
+//
+//   SnapshotHeader | SnapshotColumn[columnCount] | pad | column 0 | pad | column 1 | ...
+constexpr uint32_t SNAPSHOT_VERSION = 1;
+constexpr uint64_t SNAPSHOT_ALIGN = 4096;
+constexpr char SNAPSHOT_MAGIC[8] = {'B', 'H', 'S', 'N', 'A', 'P', '\r', '\n'};
+
+struct SnapshotHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t columnCount;
+    uint64_t step; // simulation steps taken when the snapshot was made
+    uint64_t fileSize;
+    uint32_t byteOrder; // 0x01020304 as written
+    uint32_t reserved[7];
+};
+
+struct SnapshotColumn
+{
+    char name[24]; // NUL-padded, e.g. "tracer.x"
+    uint32_t elementSize;
+    uint32_t reserved;
+    uint64_t count;
+    uint64_t offset; // from the start of the file
+};
+
+static_assert(sizeof(SnapshotHeader) == 64 && sizeof(SnapshotColumn) == 48);
+
+// A column to write: `count` elements of `elementSize` bytes at `data`
+struct SnapshotColumnRef
+{
+    std::string_view name;
+    const void* data;
+    uint32_t elementSize;
+    uint64_t count;
+};
+
+template <typename T>
+SnapshotColumnRef snapshotColumn(std::string_view name, std::span<const T> data)
+{
+    return {name, data.data(), sizeof(T), data.size()};
+}
+
+inline uint64_t snapshotAlign(uint64_t offset)
+{
+    return (offset + SNAPSHOT_ALIGN - 1) / SNAPSHOT_ALIGN * SNAPSHOT_ALIGN;
+}
+
+// Forces a file's data, or a directory's entries, to the disk
+inline bool syncToDisk(const std::filesystem::path& path)
+{
+#ifdef _WIN32
+    const HANDLE file = CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING,
+                                    FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    const bool ok = FlushFileBuffers(file) != 0;
+    CloseHandle(file);
+    return ok;
+#else
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    const bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#endif
+}
+
+// Writes to `path`.tmp, syncs it, renames it over `path` and syncs the directory, so a crash
+// leaves either the old snapshot or the new one, never a torn one
+inline bool writeSnapshot(const std::filesystem::path& path, uint64_t step, std::span<const SnapshotColumnRef> columns)
+{
+    std::vector<SnapshotColumn> directory(columns.size());
+    uint64_t offset = sizeof(SnapshotHeader) + columns.size() * sizeof(SnapshotColumn);
+    for (size_t i = 0; i < columns.size(); ++i)
+    {
+        if (columns[i].name.size() >= sizeof(directory[i].name))
+            return false;
+        std::memset(&directory[i], 0, sizeof(SnapshotColumn));
+        std::memcpy(directory[i].name, columns[i].name.data(), columns[i].name.size());
+        directory[i].elementSize = columns[i].elementSize;
+        directory[i].count = columns[i].count;
+        directory[i].offset = offset = snapshotAlign(offset);
+        offset += columns[i].count * columns[i].elementSize;
+    }
+
+    SnapshotHeader header{};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.columnCount = static_cast<uint32_t>(columns.size());
+    header.step = step;
+    header.fileSize = offset;
+    header.byteOrder = 0x01020304;
+
+    std::filesystem::path tmp = path;
+    tmp += ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out)
+            return false;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(directory.data()), directory.size() * sizeof(SnapshotColumn));
+
+        static constexpr char zeros[SNAPSHOT_ALIGN] = {};
+        uint64_t written = sizeof(header) + directory.size() * sizeof(SnapshotColumn);
+        for (size_t i = 0; i < columns.size(); ++i)
+        {
+            out.write(zeros, directory[i].offset - written);
+            const uint64_t bytes = directory[i].count * directory[i].elementSize;
+            out.write(static_cast<const char*>(columns[i].data), bytes);
+            written = directory[i].offset + bytes;
+        }
+        if (!out.flush())
+            return false;
+    }
+    if (!syncToDisk(tmp))
+        return false;
+
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if (ec)
+        return false;
+#ifndef _WIN32
+    syncToDisk(path.has_parent_path() ? path.parent_path() : std::filesystem::path("."));
+#endif
+    return true;
+}
+
+// Read-only file mapped copy-on-write: columns come back as writable spans over the mapping, so a
+// restored scene can be stepped in place without touching the file
+struct MappedSnapshot
+{
+    std::byte* base = nullptr;
+    uint64_t size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+
+    MappedSnapshot() = default;
+
+    explicit MappedSnapshot(const std::filesystem::path& path)
+    {
+        open(path);
+    }
+
+    ~MappedSnapshot()
+    {
+        close();
+    }
+
+    MappedSnapshot(const MappedSnapshot&) = delete;
+    MappedSnapshot& operator=(const MappedSnapshot&) = delete;
+
+    bool open(const std::filesystem::path& path)
+    {
+        close();
+#ifdef _WIN32
+        file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        LARGE_INTEGER fileSize;
+        if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize))
+            return close(), false;
+        size = uint64_t(fileSize.QuadPart);
+        mapping = CreateFileMappingW(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+        if (!mapping)
+            return close(), false;
+        base = static_cast<std::byte*>(MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0));
+#else
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            size = uint64_t(st.st_size);
+            void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+            base = p == MAP_FAILED ? nullptr : static_cast<std::byte*>(p);
+        }
+        ::close(fd); // the mapping keeps the file alive
+#endif
+        if (!base || !validate())
+            return close(), false;
+        return true;
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if (base)
+            UnmapViewOfFile(base);
+        if (mapping)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (base)
+            munmap(base, size);
+#endif
+        base = nullptr;
+        size = 0;
+    }
+
+    bool valid() const
+    {
+        return base != nullptr;
+    }
+
+    const SnapshotHeader& header() const
+    {
+        return *reinterpret_cast<const SnapshotHeader*>(base);
+    }
+
+    std::span<const SnapshotColumn> columns() const
+    {
+        return {reinterpret_cast<const SnapshotColumn*>(base + sizeof(SnapshotHeader)), header().columnCount};
+    }
+
+    // The named column as T, or an empty span if it is missing or its elements are not sizeof(T)
+    template <typename T>
+    std::span<T> column(std::string_view name) const
+    {
+        for (const auto& c : columns())
+            if (std::string_view(c.name, strnlen(c.name, sizeof(c.name))) == name)
+                return c.elementSize == sizeof(T) ? std::span<T>(reinterpret_cast<T*>(base + c.offset), c.count) : std::span<T>();
+        return {};
+    }
+
+    bool validate() const
+    {
+        if (size < sizeof(SnapshotHeader))
+            return false;
+        const SnapshotHeader& h = header();
+        if (std::memcmp(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic)) != 0 || h.version != SNAPSHOT_VERSION ||
+            h.byteOrder != 0x01020304 || h.fileSize > size ||
+            sizeof(SnapshotHeader) + uint64_t(h.columnCount) * sizeof(SnapshotColumn) > size)
+            return false;
+        for (const auto& c : columns())
+            if (c.offset % SNAPSHOT_ALIGN != 0 || c.elementSize == 0 || c.offset > h.fileSize || c.count > (h.fileSize - c.offset) / c.elementSize)
+                return false;
+        return true;
+    }
+};
+
+// Copies a mapped column into `dst` across the pool
+template <typename T>
+bool restoreColumn(JobSystem& pool, std::span<const T> src, std::vector<T>& dst, size_t expected)
+{
+    if (src.size() != expected)
+        return false;
+    dst.resize(expected);
+    pool.parallelFor(expected, [&](size_t begin, size_t end)
+                     { std::memcpy(dst.data() + begin, src.data() + begin, (end - begin) * sizeof(T)); });
+    return true;
+}
+
+// Periodic checkpoints written off the render thread. `capture` copies the columns into staging
+// buffers (in parallel, on the caller) and returns at once; a writer thread does the file I/O.
+// A capture while the previous write is still running is skipped rather than queued.
+struct CheckpointWriter
+{
+    struct Result
+    {
+        uint64_t step;
+        double seconds;
+        bool ok;
+    };
+
+    std::filesystem::path path;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool quit = false;
+    bool pending = false;           // staged data waiting for the writer, guarded by `mutex`
+    std::atomic<bool> busy = false; // staged data not yet written
+
+    // Staging, owned by the writer while `busy`
+    std::vector<std::vector<std::byte>> staged;
+    std::vector<SnapshotColumnRef> stagedColumns;
+    uint64_t stagedStep = 0;
+
+    bool hasResult = false; // guarded by `mutex`
+    Result result{};
+
+    std::thread thread; // last, so everything it touches is constructed first
+
+    explicit CheckpointWriter(std::filesystem::path file)
+        : path(std::move(file))
+        , thread([this] { writerLoop(); })
+    {
+    }
+
+    ~CheckpointWriter()
+    {
+        {
+            std::lock_guard lock(mutex);
+            quit = true;
+        }
+        wake.notify_all();
+        thread.join();
+    }
+
+    CheckpointWriter(const CheckpointWriter&) = delete;
+    CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+    bool capture(JobSystem& pool, uint64_t step, std::span<const SnapshotColumnRef> columns)
+    {
+        if (busy.exchange(true))
+            return false;
+
+        staged.resize(columns.size());
+        stagedColumns.assign(columns.begin(), columns.end());
+        for (size_t i = 0; i < columns.size(); ++i)
+        {
+            const size_t bytes = columns[i].count * columns[i].elementSize;
+            staged[i].resize(bytes);
+            const auto* src = static_cast<const std::byte*>(columns[i].data);
+            std::byte* dst = staged[i].data();
+            pool.parallelFor(bytes, [&](size_t begin, size_t end) { std::memcpy(dst + begin, src + begin, end - begin); });
+            stagedColumns[i].data = dst;
+        }
+        stagedStep = step;
+
+        {
+            std::lock_guard lock(mutex);
+            pending = true;
+        }
+        wake.notify_one();
+        return true;
+    }
+
+    // The last finished checkpoint, once
+    bool takeResult(Result& out)
+    {
+        std::lock_guard lock(mutex);
+        if (!hasResult)
+            return false;
+        hasResult = false;
+        out = result;
+        return true;
+    }
+
+    void writerLoop()
+    {
+        AllocScope scope("checkpoint writer", true); // file I/O, off the frame loop
+        while (true)
+        {
+            {
+                std::unique_lock lock(mutex);
+                wake.wait(lock, [this] { return quit || pending; });
+                if (!pending)
+                    return;
+                pending = false;
+            }
+            const auto start = std::chrono::steady_clock::now();
+            const bool ok = writeSnapshot(path, stagedStep, stagedColumns);
+            {
+                std::lock_guard lock(mutex);
+                result = {stagedStep, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), ok};
+                hasResult = true;
+            }
+            busy = false;
+        }
+    }
+};
@@ -0,0 +1,345 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "alloc_tracker.hpp"
+#include "parallel.hpp"
+
+// Coroutine for work that spans frames. Starts when spawned on a TaskScheduler, which owns it.
+struct Task
+{
+    struct promise_type
+    {
+        Task get_return_object()
+        {
+            return {std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+        std::suspend_always initial_suspend() noexcept
+        {
+            return {};
+        }
+        std::suspend_always final_suspend() noexcept
+        {
+            return {};
+        }
+        void return_void()
+        {
+        }
+        void unhandled_exception()
+        {
+            std::terminate();
+        }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+// Runs Tasks on the thread that calls `poll`, once per frame, so a task can wait on the GPU, the
+// job system or the disk in straight-line code without stalling the loop. Whatever a task waits
+// on, it resumes inside `poll`, so GL calls after a co_await are safe.
+//
+//   co_await tasks.until(ready)          // polled once per frame (GL fences, ...)
+//   co_await tasks.offload(pool, fn)     // fn() on the job system
+//   co_await tasks.writeFile(path, data) // on the file I/O thread, true on success
+//   co_await tasks.writeRows(path, ...)  // patches rows of an existing file, likewise
+struct TaskScheduler
+{
+    struct Counts
+    {
+        size_t tasks;     // spawned and not finished
+        size_t polling;   // waiting on an `until` condition
+        size_t offloaded; // waiting on the job system
+        size_t io;        // waiting on file I/O
+    };
+
+    struct Poller
+    {
+        bool (*ready)(void* awaitable);
+        void* awaitable;
+        std::coroutine_handle<> handle;
+    };
+
+    enum class IoKind
+    {
+        Read,
+        Replace, // the whole file
+        Patch,   // rows of an existing file
+    };
+
+    struct IoRequest
+    {
+        IoKind kind;
+        std::filesystem::path path;
+        std::span<const std::byte> data{};     // to write
+        std::vector<std::byte>* out = nullptr; // to read into
+        uint64_t offset = 0;                   // Patch: the first row lands here,
+        size_t rowBytes = 0;                   // and `data` is rows of this size
+        uint64_t stride = 0;                   // this far apart in the file
+        bool* ok = nullptr;
+        std::coroutine_handle<> handle{};
+    };
+
+    std::vector<std::coroutine_handle<Task::promise_type>> tasks;
+    std::vector<Poller> polling, pollingNext;
+
+    std::mutex mutex; // guards `resumable`
+    std::vector<std::coroutine_handle<>> resumable, resuming;
+    std::atomic<size_t> offloaded = 0;
+    std::atomic<size_t> io = 0;
+
+    std::mutex ioMutex; // guards `ioQueue` and `ioQuit`
+    std::condition_variable ioWake;
+    std::vector<IoRequest> ioQueue;
+    bool ioQuit = false;
+
+    std::thread ioThread; // last, so everything it touches is constructed first
+
+    TaskScheduler()
+        : ioThread([this] { ioLoop(); })
+    {
+        // Room for a burst of resumptions without allocating in `post` or `poll`
+        resumable.reserve(64);
+        resuming.reserve(64);
+        polling.reserve(64);
+        pollingNext.reserve(64);
+    }
+
+    ~TaskScheduler()
+    {
+        // Jobs and I/O hold pointers into task frames
+        while (offloaded > 0 || io > 0)
+            std::this_thread::yield();
+        {
+            std::lock_guard lock(ioMutex);
+            ioQuit = true;
+        }
+        ioWake.notify_all();
+        ioThread.join();
+        for (auto h : tasks)
+            h.destroy();
+    }
+
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    // Runs the task up to its first co_await
+    void spawn(Task task)
+    {
+        tasks.push_back(task.handle);
+        task.handle.resume();
+    }
+
+    // Resumes the tasks whose waits completed and frees finished ones
+    void poll()
+    {
+        {
+            std::lock_guard lock(mutex);
+            resuming.swap(resumable);
+        }
+        for (auto h : resuming)
+            h.resume();
+        resuming.clear();
+
+        // Tasks resumed here may start new waits, which land in `polling`
+        pollingNext.swap(polling);
+        for (const Poller& p : pollingNext)
+        {
+            if (p.ready(p.awaitable))
+                p.handle.resume();
+            else
+                polling.push_back(p);
+        }
+        pollingNext.clear();
+
+        std::erase_if(tasks, [](auto h)
+                      {
+                          if (!h.done())
+                              return false;
+                          h.destroy();
+                          return true; });
+    }
+
+    Counts counts() const
+    {
+        return {tasks.size(), polling.size(), offloaded.load(), io.load()};
+    }
+
+    // From any thread: resume `h` in the next `poll`
+    void post(std::coroutine_handle<> h)
+    {
+        std::lock_guard lock(mutex);
+        resumable.push_back(h);
+    }
+
+    template <typename Ready>
+    struct UntilAwaitable
+    {
+        TaskScheduler& scheduler;
+        Ready ready;
+
+        bool await_ready()
+        {
+            return ready();
+        }
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            scheduler.polling.push_back({[](void* a) { return static_cast<UntilAwaitable*>(a)->ready(); }, this, h});
+        }
+        void await_resume()
+        {
+        }
+    };
+
+    // Resumes once ready() is true, checked once per `poll`
+    template <typename Ready>
+    UntilAwaitable<Ready> until(Ready ready)
+    {
+        return {*this, std::move(ready)};
+    }
+
+    template <typename Fn>
+    struct OffloadAwaitable
+    {
+        TaskScheduler& scheduler;
+        JobSystem& jobs;
+        Fn fn;
+        std::coroutine_handle<> handle;
+
+        bool await_ready()
+        {
+            return false;
+        }
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            handle = h;
+            ++scheduler.offloaded;
+            jobs.detach(*this);
+        }
+        void await_resume()
+        {
+        }
+
+        // On the job system. The frame holding *this may be gone once the task is posted.
+        void operator()()
+        {
+            fn();
+            TaskScheduler& s = scheduler;
+            s.post(handle);
+            --s.offloaded;
+        }
+    };
+
+    // Runs fn() as a job and resumes in the `poll` after it finished
+    template <typename Fn>
+    OffloadAwaitable<Fn> offload(JobSystem& jobs, Fn fn)
+    {
+        return {*this, jobs, std::move(fn), {}};
+    }
+
+    struct IoAwaitable
+    {
+        TaskScheduler& scheduler;
+        IoRequest request;
+        bool ok = false;
+
+        bool await_ready()
+        {
+            return false;
+        }
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            request.handle = h;
+            request.ok = &ok;
+            ++scheduler.io;
+            {
+                std::lock_guard lock(scheduler.ioMutex);
+                scheduler.ioQueue.push_back(std::move(request));
+            }
+            scheduler.ioWake.notify_one();
+        }
+        bool await_resume()
+        {
+            return ok;
+        }
+    };
+
+    // Replaces `path` with `data`, which must stay alive until resumed
+    IoAwaitable writeFile(std::filesystem::path path, std::span<const std::byte> data)
+    {
+        return {*this, {.kind = IoKind::Replace, .path = std::move(path), .data = data}};
+    }
+
+    // Writes `data`, rows of `rowBytes`, into the existing file `path`: row i at offset + i * stride
+    IoAwaitable writeRows(std::filesystem::path path, std::span<const std::byte> data, uint64_t offset, size_t rowBytes, uint64_t stride)
+    {
+        return {*this, {.kind = IoKind::Patch, .path = std::move(path), .data = data, .offset = offset, .rowBytes = rowBytes, .stride = stride}};
+    }
+
+    IoAwaitable readFile(std::filesystem::path path, std::vector<std::byte>& out)
+    {
+        return {*this, {.kind = IoKind::Read, .path = std::move(path), .out = &out}};
+    }
+
+    void ioLoop()
+    {
+        AllocScope scope("task file I/O", true); // off the frame loop
+        std::vector<IoRequest> batch;
+        while (true)
+        {
+            {
+                std::unique_lock lock(ioMutex);
+                ioWake.wait(lock, [this] { return ioQuit || !ioQueue.empty(); });
+                if (ioQueue.empty())
+                    return;
+                batch.swap(ioQueue);
+            }
+            for (IoRequest& r : batch)
+            {
+                bool ok;
+                if (r.kind == IoKind::Replace)
+                {
+                    std::ofstream file(r.path, std::ios::binary | std::ios::trunc);
+                    file.write(reinterpret_cast<const char*>(r.data.data()), std::streamsize(r.data.size()));
+                    ok = bool(file.flush());
+                }
+                else if (r.kind == IoKind::Patch)
+                {
+                    std::fstream file(r.path, std::ios::binary | std::ios::in | std::ios::out);
+                    for (size_t row = 0; file && row * r.rowBytes < r.data.size(); ++row)
+                    {
+                        file.seekp(std::streamoff(r.offset + row * r.stride));
+                        file.write(reinterpret_cast<const char*>(r.data.data() + row * r.rowBytes), std::streamsize(r.rowBytes));
+                    }
+                    ok = bool(file.flush());
+                }
+                else
+                {
+                    std::ifstream file(r.path, std::ios::binary | std::ios::ate);
+                    ok = bool(file);
+                    if (ok)
+                    {
+                        r.out->resize(size_t(file.tellg()));
+                        file.seekg(0);
+                        ok = bool(file.read(reinterpret_cast<char*>(r.out->data()), std::streamsize(r.out->size())));
+                    }
+                }
+                *r.ok = ok;
+                post(r.handle);
+                --io;
+            }
+            batch.clear();
+        }
+    }
+};
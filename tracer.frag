@@ -0,0 +1,5 @@
+#version 330 core
+out vec4 FragColor;
+void main() {
+    FragColor = vec4(0.8, 0.85, 1.0, 0.35); // faint blue-white specks
+}
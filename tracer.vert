@@ -0,0 +1,8 @@
+#version 330 core
+layout(location = 0) in float posX;
+layout(location = 1) in float posY;
+layout(location = 2) in float posZ;
+uniform mat4 viewProj;
+void main() {
+    gl_Position = viewProj * vec4(posX, posY, posZ, 1.0);
+}
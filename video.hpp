@@ -0,0 +1,247 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <format>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <csignal>
+#endif
+
+#include "alloc_tracker.hpp"
+#include "lockfree.hpp"
+#include "parallel.hpp"
+
+// Uncompressed video for an external encoder, written on its own thread.
+//
+// The producer fills a free frame with top-down RGB8 rows and submits it; the writer converts it
+// and appends it to a file, or to the stdin of a command when the path starts with '|':
+//
+//   --record capture.y4m                               // YUV4MPEG2, 4:2:0, full range
+//   --record frames.rgb                                // raw rgb24, size and rate in the log
+//   --record "|ffmpeg -y -i - -c:v libx264 out.mp4"    // Y4M into ffmpeg
+//
+// A fixed set of frames circulates between the two sides, so recording allocates only at start.
+enum class VideoFormat
+{
+    Y4M, // YUV4MPEG2 4:2:0, converted from RGB on the writer
+    RGB, // raw rgb24 frames back to back
+};
+
+struct VideoEncoder
+{
+    static constexpr int FRAMES = 4;
+
+    struct Stats
+    {
+        uint64_t frames = 0;
+        uint64_t bytes = 0;
+        double encodeSeconds = 0.0; // converting and writing
+    };
+
+    JobSystem& jobs; // converts rows
+    VideoFormat format;
+    int width, height, fps;
+    std::string target;
+    FILE* out = nullptr;
+    bool pipe = false;
+
+    std::array<std::vector<std::byte>, FRAMES> frames; // rgb24, top-down
+    SpscQueue<int, 8> filled;                          // frames to write, main to writer
+    SpscQueue<int, 8> free;                            // frames written, writer to main
+    std::vector<std::byte> encoded;                    // writer's Y4M frame
+
+    std::mutex mutex; // guards `quit`, sleeps the writer
+    std::condition_variable wake;
+    bool quit = false;
+
+    std::atomic<bool> failed = false;
+    std::mutex statsMutex; // guards `stats`
+    Stats stats;
+
+    std::thread thread; // started by `open`
+
+    VideoEncoder(JobSystem& pool, VideoFormat fmt, int w, int h, int rate)
+        : jobs(pool)
+        , format(fmt)
+        , width(w)
+        , height(h)
+        , fps(rate)
+    {
+    }
+
+    ~VideoEncoder()
+    {
+        close();
+    }
+
+    VideoEncoder(const VideoEncoder&) = delete;
+    VideoEncoder& operator=(const VideoEncoder&) = delete;
+
+    // `path` is a file, or "|command" to pipe into; false if it cannot be opened
+    bool open(const std::string& path)
+    {
+        target = path;
+        pipe = !path.empty() && path[0] == '|';
+        if (pipe)
+        {
+#ifdef _WIN32
+            out = _popen(path.c_str() + 1, "wb");
+#else
+            std::signal(SIGPIPE, SIG_IGN); // a dead encoder fails the write instead of killing us
+            out = popen(path.c_str() + 1, "w");
+#endif
+        }
+        else
+        {
+            out = std::fopen(path.c_str(), "wb");
+        }
+        if (!out)
+            return false;
+
+        for (int i = 0; i < FRAMES; ++i)
+        {
+            frames[i].resize(size_t(width) * height * 3);
+            free.push(i);
+        }
+        if (format == VideoFormat::Y4M)
+        {
+            const std::string header = std::format("YUV4MPEG2 W{} H{} F{}:1 Ip A1:1 C420jpeg XYSCSS=420JPEG XCOLORRANGE=FULL\n", width, height, fps);
+            std::fwrite(header.data(), 1, header.size(), out);
+            encoded.resize(6 + size_t(width) * height + 2 * chromaSize());
+        }
+        thread = std::thread([this] { writerLoop(); });
+        return true;
+    }
+
+    // Waits for the submitted frames to be written and closes the output
+    void close()
+    {
+        if (!thread.joinable())
+            return;
+        {
+            std::lock_guard lock(mutex);
+            quit = true;
+        }
+        wake.notify_all();
+        thread.join();
+#ifdef _WIN32
+        pipe ? _pclose(out) : std::fclose(out);
+#else
+        pipe ? pclose(out) : std::fclose(out);
+#endif
+        out = nullptr;
+    }
+
+    // Producer side: a frame to fill, or nullptr while the writer is behind
+    std::byte* acquire(int& index)
+    {
+        return free.pop(index) ? frames[index].data() : nullptr;
+    }
+
+    void submit(int index)
+    {
+        filled.push(index); // never full: only FRAMES indices exist
+        {
+            std::lock_guard lock(mutex);
+        }
+        wake.notify_one();
+    }
+
+    Stats snapshot()
+    {
+        std::lock_guard lock(statsMutex);
+        return stats;
+    }
+
+    size_t chromaSize() const
+    {
+        return size_t((width + 1) / 2) * ((height + 1) / 2);
+    }
+
+    // Full-range BT.601, chroma averaged over 2x2 blocks
+    void toY4M(const std::byte* rgb)
+    {
+        std::memcpy(encoded.data(), "FRAME\n", 6);
+        uint8_t* yPlane = reinterpret_cast<uint8_t*>(encoded.data()) + 6;
+        uint8_t* uPlane = yPlane + size_t(width) * height;
+        uint8_t* vPlane = uPlane + chromaSize();
+        const int chromaWidth = (width + 1) / 2;
+        const auto* src = reinterpret_cast<const uint8_t*>(rgb);
+
+        jobs.parallelFor(size_t(height + 1) / 2, [&](size_t begin, size_t end)
+                         {
+                             for (size_t cy = begin; cy < end; ++cy)
+                             {
+                                 for (int cx = 0; cx < chromaWidth; ++cx)
+                                 {
+                                     int r = 0, g = 0, b = 0, n = 0;
+                                     for (int dy = 0; dy < 2; ++dy)
+                                     {
+                                         const int y = std::min(int(cy) * 2 + dy, height - 1);
+                                         for (int dx = 0; dx < 2; ++dx)
+                                         {
+                                             const int x = std::min(cx * 2 + dx, width - 1);
+                                             const uint8_t* p = src + (size_t(y) * width + x) * 3;
+                                             yPlane[size_t(y) * width + x] = uint8_t((77 * p[0] + 150 * p[1] + 29 * p[2] + 128) >> 8);
+                                             r += p[0];
+                                             g += p[1];
+                                             b += p[2];
+                                             ++n;
+                                         }
+                                     }
+                                     r /= n;
+                                     g /= n;
+                                     b /= n;
+                                     const size_t c = cy * chromaWidth + cx;
+                                     uPlane[c] = uint8_t(std::clamp((-43 * r - 85 * g + 128 * b + 128 * 256 + 128) >> 8, 0, 255));
+                                     vPlane[c] = uint8_t(std::clamp((128 * r - 107 * g - 21 * b + 128 * 256 + 128) >> 8, 0, 255));
+                                 }
+                             } });
+    }
+
+    void writerLoop()
+    {
+        AllocScope scope("video writer", true); // file I/O, off the frame loop
+        while (true)
+        {
+            int index;
+            if (!filled.pop(index))
+            {
+                std::unique_lock lock(mutex);
+                if (quit && filled.head == filled.tail)
+                    return;
+                wake.wait(lock, [this] { return quit || filled.head != filled.tail; });
+                continue;
+            }
+
+            const auto start = std::chrono::steady_clock::now();
+            std::span<const std::byte> bytes = frames[index];
+            if (format == VideoFormat::Y4M)
+            {
+                toY4M(frames[index].data());
+                bytes = encoded;
+            }
+            if (!failed && std::fwrite(bytes.data(), 1, bytes.size(), out) != bytes.size())
+                failed = true;
+            free.push(index);
+
+            std::lock_guard lock(statsMutex);
+            ++stats.frames;
+            stats.bytes += bytes.size();
+            stats.encodeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+    }
+};
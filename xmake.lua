@@ -10,3 +10,12 @@ target("black-hole")
     set_rundir(".")
     add_packages("glfw", "glm", "glew")
     add_files("main.cpp")
+    if is_mode("debug") then
+        add_defines("BH_TRACK_ALLOCATIONS")
+    end
+    if is_plat("linux") then
+        add_syslinks("pthread", "EGL")
+    end
+    if is_plat("windows") then
+        add_syslinks("ws2_32")
+    end